@@ -0,0 +1,356 @@
+/******************************************************************************
+ *
+ * AnalyzeSession.cpp
+ *
+ * Report the encoder behaviour of every camera of a recorded session: GOP
+ * lengths, I and P frame sizes, bitrate per second, frame interval jitter,
+ * late frames and frame size outliers, as a text table and optionally as
+ * JSON. Only metadata is read: frame types come from the mcam_idx_<id>
+ * frame indexes, sizes and timestamps from them or from the metadata
+ * sidecars of cameras without an index. With -n missing indexes are built
+ * from the NAL headers of the streams first. Cameras are analyzed in
+ * parallel.
+ *
+ *****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include "mantis/MantisAPI.h"
+#include "SessionFiles.h"
+#include "FrameIndex.h"
+#include "NalParser.h"
+#include "ThreadPool.h"
+
+// frames further than this many standard deviations above the mean size of their type are outliers
+#define OUTLIER_SIGMA 4.0
+
+struct Distribution {
+    double min;
+    double mean;
+    double max;
+    double stddev;
+    double median;
+    double p95;
+};
+
+struct CameraReport {
+    uint32_t mcamId;
+    std::string error;
+    bool frameTypes;            // frame types known from the frame index
+    int codec;
+    uint64_t frames;
+    uint64_t bytes;
+    double seconds;             // first to last timestamp
+    double fps;
+    double bitrate;             // bit/s over the recording
+    Distribution secondBitrate; // bit/s of every whole second
+    Distribution interval;      // frame interval in microseconds
+    uint64_t lateFrames;        // intervals over 1.5 frame periods, i.e. frames lost before them
+    uint64_t earlyFrames;       // intervals under half a frame period
+    uint64_t nonIncreasing;     // timestamps not after the one before
+    uint64_t keyframes;
+    uint64_t gops;              // complete GOPs, from one key frame to the next
+    Distribution gopLength;     // frames
+    double keyframeSize;        // mean bytes
+    double otherSize;
+    uint64_t sizeOutliers;
+};
+
+static Distribution distribution(std::vector<double>& values) {
+    Distribution d;
+    memset(&d, 0, sizeof(d));
+    if (values.empty())
+        return d;
+    double sum = 0;
+    double sum2 = 0;
+    d.min = values[0];
+    d.max = values[0];
+    for (size_t i = 0; i < values.size(); i ++) {
+        sum += values[i];
+        sum2 += values[i] * values[i];
+        d.min = std::min(d.min, values[i]);
+        d.max = std::max(d.max, values[i]);
+    }
+    d.mean = sum / values.size();
+    d.stddev = sqrt(std::max(0.0, sum2 / values.size() - d.mean * d.mean));
+    std::nth_element(values.begin(), values.begin() + values.size() / 2, values.end());
+    d.median = values[values.size() / 2];
+    size_t p = std::min(values.size() - 1, (size_t)(values.size() * 0.95));
+    std::nth_element(values.begin(), values.begin() + p, values.end());
+    d.p95 = values[p];
+    return d;
+}
+
+/**
+ * @brief frames of a camera from its frame index, or sizes and timestamps from the sidecar
+ */
+static int loadFrames(const std::string& dir, uint32_t mcamId, bool parse, std::vector<FrameIndexEntry>& frames,
+    CameraReport& report) {
+    if (parse || access(indexFileName(dir, mcamId).c_str(), F_OK) == 0) {
+        FrameIndex index;
+        if (index.open(dir, mcamId) != 0)
+            return -1;
+        if (index.size() > 0)
+            frames.assign(&index[0], &index[0] + index.size());
+        report.frameTypes = true;
+        report.codec = index.codec();
+        return 0;
+    }
+    FILE* fpmeta = fopen(metaFileName(dir, mcamId).c_str(), "rb");
+    if (fpmeta == NULL)
+        return -1;
+    std::vector<FRAME_METADATA> records(4096);
+    size_t n;
+    while ((n = fread(&records[0], sizeof(FRAME_METADATA), records.size(), fpmeta)) > 0) {
+        for (size_t i = 0; i < n; i ++) {
+            FrameIndexEntry entry;
+            memset(&entry, 0, sizeof(entry));
+            entry.timestamp = records[i].m_timestamp;
+            entry.size = (uint32_t)records[i].m_size;
+            frames.push_back(entry);
+        }
+    }
+    fclose(fpmeta);
+    return 0;
+}
+
+static void analyzeCamera(const std::string& dir, uint32_t mcamId, bool parse, CameraReport& report) {
+    report.mcamId = mcamId;
+    report.frameTypes = false;
+    report.codec = CODEC_UNKNOWN;
+    report.frames = 0;
+    report.bytes = 0;
+    report.seconds = 0;
+    report.fps = 0;
+    report.bitrate = 0;
+    memset(&report.secondBitrate, 0, sizeof(report.secondBitrate));
+    memset(&report.interval, 0, sizeof(report.interval));
+    memset(&report.gopLength, 0, sizeof(report.gopLength));
+    report.lateFrames = 0;
+    report.earlyFrames = 0;
+    report.nonIncreasing = 0;
+    report.keyframes = 0;
+    report.gops = 0;
+    report.keyframeSize = 0;
+    report.otherSize = 0;
+    report.sizeOutliers = 0;
+    std::vector<FrameIndexEntry> frames;
+    if (loadFrames(dir, mcamId, parse, frames, report) != 0) {
+        report.error = "cannot read metadata";
+        return;
+    }
+    report.frames = frames.size();
+    if (frames.empty())
+        return;
+
+    std::vector<double> intervals;
+    intervals.reserve(frames.size());
+    for (size_t i = 0; i < frames.size(); i ++) {
+        report.bytes += frames[i].size;
+        if (i == 0)
+            continue;
+        if (frames[i].timestamp <= frames[i - 1].timestamp)
+            report.nonIncreasing++;
+        else intervals.push_back((double)(frames[i].timestamp - frames[i - 1].timestamp));
+    }
+    report.seconds = (frames.back().timestamp - frames[0].timestamp) / 1e6;
+    if (report.seconds > 0) {
+        report.fps = (frames.size() - 1) / report.seconds;
+        report.bitrate = report.bytes * 8.0 / report.seconds;
+    }
+    report.interval = distribution(intervals);
+    for (size_t i = 0; i < intervals.size(); i ++) {
+        if (intervals[i] > report.interval.median * 1.5)
+            report.lateFrames++;
+        else if (intervals[i] < report.interval.median * 0.5)
+            report.earlyFrames++;
+    }
+
+    // bytes of every whole second of the recording
+    std::vector<double> seconds((size_t)report.seconds, 0.0);
+    for (size_t i = 0; i < frames.size() && !seconds.empty(); i ++) {
+        size_t s = (size_t)((frames[i].timestamp - frames[0].timestamp) / 1000000);
+        if (frames[i].timestamp >= frames[0].timestamp && s < seconds.size())
+            seconds[s] += frames[i].size * 8.0;
+    }
+    report.secondBitrate = distribution(seconds);
+
+    // size statistics per frame type, all frames count as non key frames without types
+    double sum[2] = { 0, 0 };
+    double sum2[2] = { 0, 0 };
+    uint64_t count[2] = { 0, 0 };
+    std::vector<double> gops;
+    size_t lastKeyframe = frames.size();
+    for (size_t i = 0; i < frames.size(); i ++) {
+        int key = frames[i].keyframe ? 1 : 0;
+        sum[key] += frames[i].size;
+        sum2[key] += (double)frames[i].size * frames[i].size;
+        count[key]++;
+        if (key) {
+            if (lastKeyframe < frames.size())
+                gops.push_back((double)(i - lastKeyframe));
+            lastKeyframe = i;
+        }
+    }
+    double mean[2];
+    double limit[2];
+    for (int k = 0; k < 2; k ++) {
+        mean[k] = count[k] ? sum[k] / count[k] : 0;
+        double var = count[k] ? sum2[k] / count[k] - mean[k] * mean[k] : 0;
+        limit[k] = mean[k] + OUTLIER_SIGMA * sqrt(std::max(0.0, var));
+    }
+    for (size_t i = 0; i < frames.size(); i ++)
+        if (frames[i].size > limit[frames[i].keyframe ? 1 : 0])
+            report.sizeOutliers++;
+    report.keyframes = count[1];
+    report.keyframeSize = mean[1];
+    report.otherSize = mean[0];
+    report.gops = gops.size();
+    report.gopLength = distribution(gops);
+}
+
+static void writeDistribution(FILE* fp, const char* name, const Distribution& d, double scale) {
+    fprintf(fp, "\"%s\": {\"min\": %.3f, \"mean\": %.3f, \"median\": %.3f, \"p95\": %.3f, \"max\": %.3f, "
+        "\"stddev\": %.3f}", name, d.min * scale, d.mean * scale, d.median * scale, d.p95 * scale,
+        d.max * scale, d.stddev * scale);
+}
+
+static void writeJson(FILE* fp, const std::string& dir, const std::vector<CameraReport>& reports) {
+    uint64_t frames = 0;
+    uint64_t bytes = 0;
+    double bitrate = 0;
+    double minBitrate = 0;
+    double maxBitrate = 0;
+    size_t valid = 0;
+    fprintf(fp, "{\n  \"session\": \"%s\",\n  \"cameras\": [", dir.c_str());
+    for (size_t i = 0; i < reports.size(); i ++) {
+        const CameraReport& r = reports[i];
+        fprintf(fp, "%s\n    {\n      \"mcam_id\": %u,\n", i ? "," : "", r.mcamId);
+        if (!r.error.empty()) {
+            fprintf(fp, "      \"error\": \"%s\"\n    }", r.error.c_str());
+            continue;
+        }
+        frames += r.frames;
+        bytes += r.bytes;
+        bitrate += r.bitrate;
+        minBitrate = valid == 0 || r.bitrate < minBitrate ? r.bitrate : minBitrate;
+        maxBitrate = std::max(maxBitrate, r.bitrate);
+        valid++;
+        fprintf(fp, "      \"codec\": \"%s\", \"frame_types\": %s,\n", codecName(r.codec),
+            r.frameTypes ? "true" : "false");
+        fprintf(fp, "      \"frames\": %llu, \"bytes\": %llu, \"seconds\": %.3f, \"fps\": %.3f, "
+            "\"bitrate_mbps\": %.3f,\n", (unsigned long long)r.frames, (unsigned long long)r.bytes, r.seconds,
+            r.fps, r.bitrate / 1e6);
+        fprintf(fp, "      ");
+        writeDistribution(fp, "second_bitrate_mbps", r.secondBitrate, 1e-6);
+        fprintf(fp, ",\n      ");
+        writeDistribution(fp, "frame_interval_ms", r.interval, 1e-3);
+        fprintf(fp, ",\n      \"late_frames\": %llu, \"early_frames\": %llu, \"non_increasing_timestamps\": %llu,\n",
+            (unsigned long long)r.lateFrames, (unsigned long long)r.earlyFrames,
+            (unsigned long long)r.nonIncreasing);
+        fprintf(fp, "      \"keyframes\": %llu, \"gops\": %llu, ", (unsigned long long)r.keyframes,
+            (unsigned long long)r.gops);
+        writeDistribution(fp, "gop_length", r.gopLength, 1);
+        fprintf(fp, ",\n      \"keyframe_bytes\": %.1f, \"other_frame_bytes\": %.1f, \"ip_ratio\": %.3f, "
+            "\"size_outliers\": %llu\n    }", r.keyframeSize, r.otherSize,
+            r.otherSize > 0 ? r.keyframeSize / r.otherSize : 0.0, (unsigned long long)r.sizeOutliers);
+    }
+    fprintf(fp, "\n  ],\n  \"summary\": {\"cameras\": %lu, \"frames\": %llu, \"bytes\": %llu, "
+        "\"bitrate_mbps\": %.3f, \"min_camera_bitrate_mbps\": %.3f, \"max_camera_bitrate_mbps\": %.3f}\n}\n",
+        valid, (unsigned long long)frames, (unsigned long long)bytes, bitrate / 1e6, minBitrate / 1e6,
+        maxBitrate / 1e6);
+}
+
+static void printTable(const std::vector<CameraReport>& reports) {
+    printf("%-6s %-5s %8s %7s %8s %8s %8s %8s %6s %5s %14s %7s %6s\n", "mcam", "codec", "frames", "fps",
+        "Mbit/s", "max 1s", "int ms", "jitter", "late", "IDR", "GOP min/avg/max", "I/P", "outl");
+    double bitrate = 0;
+    uint64_t frames = 0;
+    for (size_t i = 0; i < reports.size(); i ++) {
+        const CameraReport& r = reports[i];
+        if (!r.error.empty()) {
+            printf("%-6u %s\n", r.mcamId, r.error.c_str());
+            continue;
+        }
+        char gop[32] = "-";
+        char ratio[16] = "-";
+        if (r.gops > 0)
+            sprintf(gop, "%.0f/%.1f/%.0f", r.gopLength.min, r.gopLength.mean, r.gopLength.max);
+        if (r.frameTypes && r.otherSize > 0)
+            sprintf(ratio, "%.2f", r.keyframeSize / r.otherSize);
+        printf("%-6u %-5s %8llu %7.2f %8.2f %8.2f %8.2f %8.3f %6llu %5s %14s %7s %6llu\n", r.mcamId,
+            r.frameTypes ? codecName(r.codec) : "-", (unsigned long long)r.frames, r.fps, r.bitrate / 1e6,
+            r.secondBitrate.max / 1e6, r.interval.median / 1e3, r.interval.stddev / 1e3,
+            (unsigned long long)r.lateFrames, r.frameTypes ? std::to_string(r.keyframes).c_str() : "-", gop,
+            ratio, (unsigned long long)r.sizeOutliers);
+        bitrate += r.bitrate;
+        frames += r.frames;
+    }
+    printf("Session: %lu cameras, %llu frames, %.2f Mbit/s\n", reports.size(), (unsigned long long)frames,
+        bitrate / 1e6);
+}
+
+void printHelp() {
+    printf("Report GOP, frame size, bitrate and frame interval statistics of a recorded session\n");
+    printf("Usage: AnalyzeSession <session dir> [-n] [-j threads] [-o report.json] [mcam id ...]\n");
+    printf("\t-n      build missing frame indexes from the NAL headers of the streams\n");
+    printf("\t-j n    cameras analyzed in parallel (default: number of cores)\n");
+    printf("\t-o file write the report as JSON to file, - for stdout\n");
+    printf("\tmcam id cameras to analyze, default all cameras of the session\n");
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2 || strcmp(argv[1], "-h") == 0) {
+        printHelp();
+        return argc < 2 ? -1 : 0;
+    }
+    std::string dir = argv[1];
+    bool parse = false;
+    int threads = 0;
+    std::string output;
+    std::vector<uint32_t> ids;
+    for (int i = 2; i < argc; i ++) {
+        if (strcmp(argv[i], "-n") == 0)
+            parse = true;
+        else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+            output = argv[++i];
+        else ids.push_back(atoi(argv[i]));
+    }
+    if (ids.empty())
+        ids = listCameras(dir);
+    if (ids.empty()) {
+        printf("No recorded camera in %s!\n", dir.c_str());
+        return -1;
+    }
+
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    std::vector<CameraReport> reports(ids.size());
+    parallelFor(ids.size(), threads, [&](size_t i) {
+        analyzeCamera(dir, ids[i], parse, reports[i]);
+    });
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    if (output != "-") {
+        printTable(reports);
+        printf("Analyzed in %.2f s\n", seconds);
+    }
+    if (!output.empty()) {
+        FILE* fp = output == "-" ? stdout : fopen(output.c_str(), "w");
+        if (fp == NULL) {
+            printf("Open output file %s failed!\n", output.c_str());
+            return -1;
+        }
+        writeJson(fp, dir, reports);
+        if (fp != stdout)
+            fclose(fp);
+    }
+    return 0;
+}
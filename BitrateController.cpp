@@ -0,0 +1,194 @@
+#include "BitrateController.h"
+#include "SessionFiles.h"
+
+#include <time.h>
+#include <sys/time.h>
+#include <algorithm>
+
+// shift one QP value, staying between its initial value and maxQp; 0 means unset
+static uint8_t shiftQp(uint8_t value, uint8_t initial, int step, int maxQp) {
+    if (initial == 0)
+        return value;
+    int v = value + step;
+    if (v > maxQp)
+        v = std::max<int>(maxQp, initial);
+    if (v < initial)
+        v = initial;
+    return (uint8_t)v;
+}
+
+static void shiftQpRanges(AtlCompressionParameters& cp, const AtlCompressionParameters& initial,
+    int step, int maxQp) {
+    cp.qp_iframe = shiftQp(cp.qp_iframe, initial.qp_iframe, step, maxQp);
+    cp.qp_min_iframe = shiftQp(cp.qp_min_iframe, initial.qp_min_iframe, step, maxQp);
+    cp.qp_max_iframe = shiftQp(cp.qp_max_iframe, initial.qp_max_iframe, step, maxQp);
+    cp.qp_pframe = shiftQp(cp.qp_pframe, initial.qp_pframe, step, maxQp);
+    cp.qp_min_pframe = shiftQp(cp.qp_min_pframe, initial.qp_min_pframe, step, maxQp);
+    cp.qp_max_pframe = shiftQp(cp.qp_max_pframe, initial.qp_max_pframe, step, maxQp);
+}
+
+static bool sameParameters(const AtlCompressionParameters& a, const AtlCompressionParameters& b) {
+    return a.target_bitrate == b.target_bitrate && a.qp_iframe == b.qp_iframe &&
+        a.qp_min_iframe == b.qp_min_iframe && a.qp_max_iframe == b.qp_max_iframe &&
+        a.qp_pframe == b.qp_pframe && a.qp_min_pframe == b.qp_min_pframe &&
+        a.qp_max_pframe == b.qp_max_pframe;
+}
+
+BitrateController::BitrateController(FrameRecorder& recorder, const RateControlConfig& config,
+    Setter setter) : recorder(recorder), config(config), setter(setter), running(false) {}
+
+BitrateController::~BitrateController() {
+    stop();
+    for (size_t i = 0; i < cameras.size(); i ++)
+        if (cameras[i].fpLog)
+            fclose(cameras[i].fpLog);
+}
+
+int BitrateController::addCamera(uint32_t mcamId, const AtlCompressionParameters& initial) {
+    if (running)
+        return -1;
+    if (config.maxBitrate == 0 && initial.target_bitrate == 0) {
+        printf("Camera %u reports no target bitrate, bitrate control disabled for it\n", mcamId);
+        return -1;
+    }
+    Camera cam;
+    cam.mcamId = mcamId;
+    cam.initial = initial;
+    cam.current = initial;
+    cam.maxBitrate = config.maxBitrate > 0 ? config.maxBitrate : initial.target_bitrate;
+    cam.calm = 0;
+    cam.written = 0;
+    cam.received = 0;
+    cam.dropped = 0;
+    cam.fpLog = fopen(rateControlFileName(recorder.getConfig().dir, mcamId).c_str(), "w");
+    if (cam.fpLog == NULL) {
+        printf("Open rate control log of camera %u failed!\n", mcamId);
+        return -1;
+    }
+    fprintf(cam.fpLog, "# wall_time\tframe_timestamp\told_bitrate\tnew_bitrate\t"
+        "qp_min_i\tqp_max_i\tqp_min_p\tqp_max_p\tqueue_depth\tdisk_MBps\treason\n");
+    fprintf(cam.fpLog, "# initial bitrate %llu, qp i %d [%d, %d], qp p %d [%d, %d], bounds [%llu, %llu]\n",
+        (unsigned long long)initial.target_bitrate, initial.qp_iframe, initial.qp_min_iframe,
+        initial.qp_max_iframe, initial.qp_pframe, initial.qp_min_pframe, initial.qp_max_pframe,
+        (unsigned long long)config.minBitrate, (unsigned long long)cam.maxBitrate);
+    fflush(cam.fpLog);
+    cameras.push_back(cam);
+    return 0;
+}
+
+int BitrateController::start() {
+    if (running)
+        return -1;
+    running = true;
+    lastUpdate = std::chrono::steady_clock::now();
+    thread = std::thread(&BitrateController::loop, this);
+    return 0;
+}
+
+void BitrateController::stop() {
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        if (!running)
+            return;
+        running = false;
+    }
+    cond.notify_all();
+    thread.join();
+}
+
+void BitrateController::loop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    std::chrono::duration<double> interval(config.interval);
+    while (running) {
+        cond.wait_for(lock, interval);
+        if (!running)
+            break;
+        lock.unlock();
+        update();
+        lock.lock();
+    }
+}
+
+bool BitrateController::apply(Camera& cam, const AtlCompressionParameters& cp,
+    const CameraStats& stats, double diskRate, const char* reason) {
+    if (sameParameters(cam.current, cp))
+        return false;
+    if (!setter(cam.mcamId, cp)) {
+        printf("Set compression parameters of camera %u failed!\n", cam.mcamId);
+        return false;
+    }
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    fprintf(cam.fpLog, "%ld.%03ld\t%llu\t%llu\t%llu\t%d\t%d\t%d\t%d\t%lu\t%.2f\t%s\n",
+        (long)tv.tv_sec, (long)tv.tv_usec / 1000, (unsigned long long)stats.lastTimestamp,
+        (unsigned long long)cam.current.target_bitrate, (unsigned long long)cp.target_bitrate,
+        cp.qp_min_iframe, cp.qp_max_iframe, cp.qp_min_pframe, cp.qp_max_pframe,
+        stats.queueDepth, diskRate / 1e6, reason);
+    fflush(cam.fpLog);
+    cam.current = cp;
+    return true;
+}
+
+void BitrateController::update() {
+    std::vector<CameraStats> stats = recorder.cameraStats();
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    double dt = std::chrono::duration<double>(now - lastUpdate).count();
+    lastUpdate = now;
+    if (dt <= 0)
+        return;
+
+    // the disk is shared by all cameras, compare what was written to what came in
+    uint64_t writtenBytes = 0;
+    uint64_t receivedBytes = 0;
+    std::vector<const CameraStats*> camStats(cameras.size(), (const CameraStats*)NULL);
+    for (size_t i = 0; i < cameras.size(); i ++) {
+        for (size_t k = 0; k < stats.size(); k ++) {
+            if (stats[k].mcamId == cameras[i].mcamId) {
+                camStats[i] = &stats[k];
+                writtenBytes += stats[k].bytes - cameras[i].written;
+                receivedBytes += stats[k].receivedBytes - cameras[i].received;
+                break;
+            }
+        }
+    }
+    double diskRate = writtenBytes / dt;
+    double diskShare = receivedBytes > 0 ? (double)writtenBytes / receivedBytes : 1.0;
+    double queueFrames = (double)recorder.getConfig().queueFrames;
+
+    for (size_t i = 0; i < cameras.size(); i ++) {
+        if (camStats[i] == NULL)
+            continue;
+        Camera& cam = cameras[i];
+        const CameraStats& s = *camStats[i];
+        uint64_t dropped = s.dropped - cam.dropped;
+        cam.written = s.bytes;
+        cam.received = s.receivedBytes;
+        cam.dropped = s.dropped;
+        double pressure = s.queueDepth / queueFrames;
+
+        if (dropped > 0 || pressure >= config.highWatermark) {
+            cam.calm = 0;
+            // step down at least by decreaseFactor, further if the disk wrote only a part
+            // of the incoming data, but never more than halve in one step
+            double factor = std::min(config.decreaseFactor, std::max(0.5, diskShare * 0.95));
+            AtlCompressionParameters cp = cam.current;
+            cp.target_bitrate = std::max<uint64_t>(config.minBitrate,
+                (uint64_t)(cam.current.target_bitrate * factor));
+            shiftQpRanges(cp, cam.initial, config.qpStep, config.maxQp);
+            apply(cam, cp, s, diskRate, dropped > 0 ? "dropped" : "congested");
+        }
+        else if (pressure <= config.lowWatermark) {
+            if (++cam.calm < config.holdIntervals)
+                continue;
+            cam.calm = 0;
+            AtlCompressionParameters cp = cam.current;
+            cp.target_bitrate = std::min<uint64_t>(cam.maxBitrate,
+                (uint64_t)(cam.current.target_bitrate * config.increaseFactor));
+            shiftQpRanges(cp, cam.initial, -config.qpStep, config.maxQp);
+            apply(cam, cp, s, diskRate, "recovered");
+        }
+        else {
+            cam.calm = 0;
+        }
+    }
+}
@@ -0,0 +1,90 @@
+/**
+ * @file BitrateController.h
+ * @brief lowers the encoder bitrate of the mcams when the recorder's writers
+ *        fall behind, and raises it back once storage keeps up again
+ *
+ * Every interval the controller reads the queue depth, drops and the written
+ * and received byte rates of FrameRecorder. A camera whose queue passes the
+ * high watermark (or that dropped frames) gets a lower target bitrate and
+ * coarser QP ranges, scaled to the share of the incoming data the disk
+ * actually managed to write. After a number of calm intervals the changes
+ * are undone step by step. Every change is appended to mcam_ratectl_<id>.
+ */
+#ifndef __BITRATE_CONTROLLER_H__
+#define __BITRATE_CONTROLLER_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
+#include "mantis/MantisAPI.h"
+#include "FrameRecorder.h"
+
+/**
+ * @brief bounds and tuning of the controller
+ */
+struct RateControlConfig {
+    uint64_t minBitrate;        //!< lowest target bitrate in bit/s
+    uint64_t maxBitrate;        //!< highest target bitrate in bit/s, 0 keeps the initial bitrate as maximum
+    int maxQp;                  //!< upper bound of the raised QP values
+    int qpStep;                 //!< QP change per step
+    double interval;            //!< seconds between evaluations
+    double highWatermark;       //!< queue fill ratio that triggers a decrease
+    double lowWatermark;        //!< queue fill ratio below which an interval counts as calm
+    double decreaseFactor;      //!< largest bitrate factor of one decrease
+    double increaseFactor;      //!< bitrate factor of one increase
+    int holdIntervals;          //!< calm intervals before an increase
+
+    RateControlConfig() : minBitrate(2000000), maxBitrate(0), maxQp(45), qpStep(2),
+        interval(1.0), highWatermark(0.5), lowWatermark(0.1), decreaseFactor(0.8),
+        increaseFactor(1.1), holdIntervals(5) {}
+};
+
+class BitrateController {
+public:
+    /** @brief applies the parameters to a camera, setMCamCompressionParameters in RecordStream */
+    typedef std::function<bool(uint32_t mcamId, const AtlCompressionParameters& cp)> Setter;
+
+    BitrateController(FrameRecorder& recorder, const RateControlConfig& config, Setter setter);
+    ~BitrateController();
+
+    /** @brief register a camera with its current encoder parameters, before start */
+    int addCamera(uint32_t mcamId, const AtlCompressionParameters& initial);
+    int start();
+    void stop();
+    /** @brief one evaluation step, called by the controller thread every interval */
+    void update();
+
+private:
+    struct Camera {
+        uint32_t mcamId;
+        AtlCompressionParameters initial;
+        AtlCompressionParameters current;
+        uint64_t maxBitrate;
+        int calm;
+        uint64_t written;
+        uint64_t received;
+        uint64_t dropped;
+        FILE* fpLog;
+    };
+
+    bool apply(Camera& cam, const AtlCompressionParameters& cp, const CameraStats& stats,
+        double diskRate, const char* reason);
+    void loop();
+
+    FrameRecorder& recorder;
+    RateControlConfig config;
+    Setter setter;
+    std::vector<Camera> cameras;
+    std::chrono::steady_clock::time_point lastUpdate;
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::thread thread;
+    bool running;
+};
+
+#endif // __BITRATE_CONTROLLER_H__
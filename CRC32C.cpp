@@ -0,0 +1,253 @@
+#include "CRC32C.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#define CRC32C_X86
+#elif defined(__aarch64__)
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#define CRC32C_ARM
+#endif
+
+// reflected Castagnoli polynomial
+#define POLY 0x82f63b78
+
+// block sizes of the three way interleaved hardware loop
+#define LONG_BLOCK 8192
+#define SHORT_BLOCK 256
+
+/*************************************************************
+* tables
+*************************************************************/
+static uint32_t gf2MatrixTimes(const uint32_t* mat, uint32_t vec) {
+    uint32_t sum = 0;
+    while (vec) {
+        if (vec & 1)
+            sum ^= *mat;
+        vec >>= 1;
+        mat++;
+    }
+    return sum;
+}
+
+static void gf2MatrixSquare(uint32_t* square, const uint32_t* mat) {
+    for (int n = 0; n < 32; n ++)
+        square[n] = gf2MatrixTimes(mat, mat[n]);
+}
+
+// operator that appends len zero bytes to a crc
+static void zerosOperator(uint32_t* even, size_t len) {
+    uint32_t odd[32];
+    odd[0] = POLY;
+    uint32_t row = 1;
+    for (int n = 1; n < 32; n ++) {
+        odd[n] = row;
+        row <<= 1;
+    }
+    gf2MatrixSquare(even, odd);
+    gf2MatrixSquare(odd, even);
+    do {
+        gf2MatrixSquare(even, odd);
+        len >>= 1;
+        if (len == 0)
+            return;
+        gf2MatrixSquare(odd, even);
+        len >>= 1;
+    } while (len);
+    memcpy(even, odd, sizeof(odd));
+}
+
+struct CRC32CTables {
+    uint32_t slice[8][256];         // slicing by 8 software tables
+    uint32_t longShift[4][256];     // shift a crc over LONG_BLOCK zero bytes
+    uint32_t shortShift[4][256];    // shift a crc over SHORT_BLOCK zero bytes
+
+    CRC32CTables() {
+        for (uint32_t n = 0; n < 256; n ++) {
+            uint32_t crc = n;
+            for (int k = 0; k < 8; k ++)
+                crc = crc & 1 ? (crc >> 1) ^ POLY : crc >> 1;
+            slice[0][n] = crc;
+        }
+        for (uint32_t n = 0; n < 256; n ++) {
+            uint32_t crc = slice[0][n];
+            for (int k = 1; k < 8; k ++) {
+                crc = slice[0][crc & 0xff] ^ (crc >> 8);
+                slice[k][n] = crc;
+            }
+        }
+        makeShift(longShift, LONG_BLOCK);
+        makeShift(shortShift, SHORT_BLOCK);
+    }
+
+    static void makeShift(uint32_t shift[4][256], size_t len) {
+        uint32_t op[32];
+        zerosOperator(op, len);
+        for (uint32_t n = 0; n < 256; n ++) {
+            shift[0][n] = gf2MatrixTimes(op, n);
+            shift[1][n] = gf2MatrixTimes(op, n << 8);
+            shift[2][n] = gf2MatrixTimes(op, n << 16);
+            shift[3][n] = gf2MatrixTimes(op, n << 24);
+        }
+    }
+};
+
+static const CRC32CTables& tables() {
+    static const CRC32CTables t;
+    return t;
+}
+
+static inline uint32_t shiftCrc(const uint32_t shift[4][256], uint32_t crc) {
+    return shift[0][crc & 0xff] ^ shift[1][(crc >> 8) & 0xff] ^
+        shift[2][(crc >> 16) & 0xff] ^ shift[3][crc >> 24];
+}
+
+/*************************************************************
+* software implementation
+*************************************************************/
+static uint32_t crc32cSoftware(uint32_t crc, const void* data, size_t len) {
+    const CRC32CTables& t = tables();
+    const uint8_t* next = (const uint8_t*)data;
+    crc = ~crc;
+    while (len && ((uintptr_t)next & 7)) {
+        crc = t.slice[0][(crc ^ *next++) & 0xff] ^ (crc >> 8);
+        len--;
+    }
+    while (len >= 8) {
+        uint64_t word;
+        memcpy(&word, next, 8);
+        word ^= crc;
+        crc = t.slice[7][word & 0xff] ^ t.slice[6][(word >> 8) & 0xff] ^
+            t.slice[5][(word >> 16) & 0xff] ^ t.slice[4][(word >> 24) & 0xff] ^
+            t.slice[3][(word >> 32) & 0xff] ^ t.slice[2][(word >> 40) & 0xff] ^
+            t.slice[1][(word >> 48) & 0xff] ^ t.slice[0][word >> 56];
+        next += 8;
+        len -= 8;
+    }
+    while (len) {
+        crc = t.slice[0][(crc ^ *next++) & 0xff] ^ (crc >> 8);
+        len--;
+    }
+    return ~crc;
+}
+
+/*************************************************************
+* hardware implementation, three independent crcs over
+* adjacent blocks hide the latency of the crc instruction
+*************************************************************/
+#if defined(CRC32C_X86) || defined(CRC32C_ARM)
+
+#if defined(CRC32C_X86)
+#define HW_TARGET __attribute__((target("sse4.2")))
+#define CRC_U8(crc, v) _mm_crc32_u8(crc, v)
+#if defined(__x86_64__)
+#define CRC_U64(crc, v) (uint32_t)_mm_crc32_u64(crc, v)
+#else
+#define CRC_U64(crc, v) _mm_crc32_u32(_mm_crc32_u32(crc, (uint32_t)(v)), (uint32_t)((v) >> 32))
+#endif
+#else
+#define HW_TARGET __attribute__((target("+crc")))
+#define CRC_U8(crc, v) __crc32cb(crc, v)
+#define CRC_U64(crc, v) __crc32cd(crc, v)
+#endif
+
+static inline uint64_t load64(const uint8_t* p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+HW_TARGET
+static uint32_t crc32cHardware(uint32_t crc, const void* data, size_t len) {
+    const CRC32CTables& t = tables();
+    const uint8_t* next = (const uint8_t*)data;
+    uint32_t crc0 = ~crc;
+    while (len && ((uintptr_t)next & 7)) {
+        crc0 = CRC_U8(crc0, *next++);
+        len--;
+    }
+    while (len >= LONG_BLOCK * 3) {
+        uint32_t crc1 = 0;
+        uint32_t crc2 = 0;
+        const uint8_t* end = next + LONG_BLOCK;
+        do {
+            crc0 = CRC_U64(crc0, load64(next));
+            crc1 = CRC_U64(crc1, load64(next + LONG_BLOCK));
+            crc2 = CRC_U64(crc2, load64(next + LONG_BLOCK * 2));
+            next += 8;
+        } while (next < end);
+        crc0 = shiftCrc(t.longShift, crc0) ^ crc1;
+        crc0 = shiftCrc(t.longShift, crc0) ^ crc2;
+        next += LONG_BLOCK * 2;
+        len -= LONG_BLOCK * 3;
+    }
+    while (len >= SHORT_BLOCK * 3) {
+        uint32_t crc1 = 0;
+        uint32_t crc2 = 0;
+        const uint8_t* end = next + SHORT_BLOCK;
+        do {
+            crc0 = CRC_U64(crc0, load64(next));
+            crc1 = CRC_U64(crc1, load64(next + SHORT_BLOCK));
+            crc2 = CRC_U64(crc2, load64(next + SHORT_BLOCK * 2));
+            next += 8;
+        } while (next < end);
+        crc0 = shiftCrc(t.shortShift, crc0) ^ crc1;
+        crc0 = shiftCrc(t.shortShift, crc0) ^ crc2;
+        next += SHORT_BLOCK * 2;
+        len -= SHORT_BLOCK * 3;
+    }
+    while (len >= 8) {
+        crc0 = CRC_U64(crc0, load64(next));
+        next += 8;
+        len -= 8;
+    }
+    while (len) {
+        crc0 = CRC_U8(crc0, *next++);
+        len--;
+    }
+    return ~crc0;
+}
+
+static bool hasHardwareCrc() {
+#if defined(CRC32C_X86)
+    return __builtin_cpu_supports("sse4.2");
+#else
+    return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+#endif
+}
+#endif
+
+/*************************************************************
+* dispatch
+*************************************************************/
+typedef uint32_t (*Crc32cFunc)(uint32_t, const void*, size_t);
+
+static Crc32cFunc selectImplementation() {
+#if defined(CRC32C_X86) || defined(CRC32C_ARM)
+    if (hasHardwareCrc())
+        return crc32cHardware;
+#endif
+    return crc32cSoftware;
+}
+
+static Crc32cFunc implementation() {
+    static const Crc32cFunc func = selectImplementation();
+    return func;
+}
+
+uint32_t crc32c(uint32_t crc, const void* data, size_t len) {
+    return implementation()(crc, data, len);
+}
+
+const char* crc32cImplementation() {
+    if (implementation() == crc32cSoftware)
+        return "software";
+#if defined(CRC32C_X86)
+    return "sse4.2";
+#else
+    return "armv8";
+#endif
+}
@@ -0,0 +1,22 @@
+/**
+ * @file CRC32C.h
+ * @brief CRC32C (Castagnoli) checksum, uses the SSE4.2 / ARMv8 crc32c
+ *        instructions when the cpu has them and a table driven fallback otherwise
+ */
+#ifndef __CRC32C_H__
+#define __CRC32C_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief extend a crc32c with len bytes, start with crc = 0
+ */
+uint32_t crc32c(uint32_t crc, const void* data, size_t len);
+
+/**
+ * @brief name of the implementation selected at runtime ("sse4.2", "armv8" or "software")
+ */
+const char* crc32cImplementation();
+
+#endif // __CRC32C_H__
@@ -0,0 +1,152 @@
+#include "ClockDrift.h"
+#include "TimeStamps.h"
+#include "ThreadPool.h"
+
+#include <math.h>
+#include <algorithm>
+
+// fewest matched frames a window needs to fit its own line
+#define MIN_PAIRS 8
+// residuals below this (us) are never rejected, timestamps jitter by some us
+#define MIN_REJECT 50.0
+
+struct ClockPair {
+    double x;           // camera time - window start
+    double y;           // reference time - camera time
+};
+
+static bool fitLine(const std::vector<ClockPair>& pairs, double& offset, double& skew) {
+    double n = (double)pairs.size();
+    double sx = 0, sy = 0, sxx = 0, sxy = 0;
+    for (size_t i = 0; i < pairs.size(); i ++) {
+        sx += pairs[i].x;
+        sy += pairs[i].y;
+        sxx += pairs[i].x * pairs[i].x;
+        sxy += pairs[i].x * pairs[i].y;
+    }
+    double det = n * sxx - sx * sx;
+    if (pairs.size() < MIN_PAIRS || det <= 0)
+        return false;
+    skew = (n * sxy - sx * sy) / det;
+    offset = (sy - skew * sx) / n;
+    return true;
+}
+
+/**
+ * @brief least squares line, refitted without the pairs further than 3 sigma
+ *        (from the median absolute deviation) from the first fit
+ */
+static bool fitRobust(std::vector<ClockPair>& pairs, double& offset, double& skew) {
+    for (int iteration = 0; iteration < 2; iteration ++) {
+        if (!fitLine(pairs, offset, skew))
+            return false;
+        std::vector<double> residuals(pairs.size());
+        for (size_t i = 0; i < pairs.size(); i ++)
+            residuals[i] = fabs(pairs[i].y - offset - skew * pairs[i].x);
+        std::vector<double> sorted = residuals;
+        std::nth_element(sorted.begin(), sorted.begin() + sorted.size() / 2, sorted.end());
+        double limit = std::max(3 * 1.4826 * sorted[sorted.size() / 2], MIN_REJECT);
+        size_t kept = 0;
+        for (size_t i = 0; i < pairs.size(); i ++)
+            if (residuals[i] <= limit)
+                pairs[kept++] = pairs[i];
+        if (kept == pairs.size())
+            break;
+        pairs.resize(kept);
+    }
+    return fitLine(pairs, offset, skew);
+}
+
+void fitClock(const uint64_t* timeStamps, size_t frames, const uint64_t* reference, size_t referenceFrames,
+    uint64_t window, uint64_t tolerance, ClockFit& fit) {
+    fit.segments.clear();
+    fit.pairs = 0;
+    fit.rms = 0;
+    fit.maxResidual = 0;
+    if (frames == 0)
+        return;
+    ClockSegment model = { timeStamps[0], 0, 0 };
+    double sum2 = 0;
+    size_t j = 0;
+    std::vector<ClockPair> pairs;
+    for (size_t begin = 0; begin < frames; ) {
+        ClockSegment segment = { timeStamps[begin], 0, model.skew };
+        segment.offset = model.offset + model.skew * ((double)segment.start - (double)model.start);
+        size_t end = begin;
+        pairs.clear();
+        for (; end < frames && timeStamps[end] < segment.start + window; end ++) {
+            double x = (double)timeStamps[end] - (double)segment.start;
+            double predicted = timeStamps[end] + segment.offset + segment.skew * x;
+            while (j + 1 < referenceFrames && reference[j + 1] <= predicted)
+                j++;
+            if (j >= referenceFrames)
+                break;
+            size_t nearest = j;
+            if (j + 1 < referenceFrames && reference[j + 1] - predicted < predicted - reference[j])
+                nearest = j + 1;
+            // the first window has no prediction yet, its outliers are left to the robust fit
+            double distance = fabs(reference[nearest] - predicted);
+            if (!fit.segments.empty() && distance > tolerance)
+                continue;
+            // with different frame rates only the frame of the faster camera nearest to the
+            // frame of the slower one was captured with it
+            if (end > 0 && fabs(reference[nearest] - (predicted - (double)(timeStamps[end] - timeStamps[end - 1])))
+                < distance)
+                continue;
+            if (end + 1 < frames && fabs(reference[nearest] - (predicted + (double)(timeStamps[end + 1] - timeStamps[end])))
+                < distance)
+                continue;
+            ClockPair pair = { x, (double)reference[nearest] - (double)timeStamps[end] };
+            pairs.push_back(pair);
+        }
+        if (end == begin)
+            end++;
+        if (fitRobust(pairs, segment.offset, segment.skew)) {
+            for (size_t i = 0; i < pairs.size(); i ++) {
+                double r = fabs(pairs[i].y - segment.offset - segment.skew * pairs[i].x);
+                sum2 += r * r;
+                fit.maxResidual = std::max(fit.maxResidual, r);
+            }
+            fit.pairs += pairs.size();
+        }
+        fit.segments.push_back(segment);
+        model = segment;
+        begin = end;
+    }
+    fit.rms = fit.pairs ? sqrt(sum2 / fit.pairs) : 0;
+}
+
+static bool segmentBefore(uint64_t timeStamp, const ClockSegment& segment) {
+    return timeStamp < segment.start;
+}
+
+uint64_t correctTimeStamp(const ClockFit& fit, uint64_t timeStamp) {
+    if (fit.segments.empty())
+        return timeStamp;
+    std::vector<ClockSegment>::const_iterator it = std::upper_bound(fit.segments.begin(), fit.segments.end(),
+        timeStamp, segmentBefore);
+    if (it != fit.segments.begin())
+        --it;
+    double corrected = timeStamp + it->offset + it->skew * ((double)timeStamp - (double)it->start);
+    return corrected > 0 ? (uint64_t)(corrected + 0.5) : 0;
+}
+
+void correctClocks(const TimeStampTable& timeStamps, int reference, uint64_t window, uint64_t tolerance,
+    int threads, std::vector<ClockFit>& fits, TimeStampTable& corrected) {
+    int numStreams = timeStamps.cameras();
+    fits.assign(numStreams, ClockFit());
+    corrected = timeStamps;
+    parallelFor(numStreams, threads, [&](size_t i) {
+        if ((int)i == reference)
+            return;
+        fitClock(timeStamps.stream((int)i), timeStamps.size((int)i), timeStamps.stream(reference),
+            timeStamps.size(reference), window, tolerance, fits[i]);
+        uint64_t* column = &corrected.data[corrected.offsets[i]];
+        for (size_t k = 0; k < corrected.size((int)i); k ++) {
+            column[k] = correctTimeStamp(fits[i], column[k]);
+            // the segments may not meet exactly, the matching needs ordered streams
+            if (k > 0 && column[k] < column[k - 1])
+                column[k] = column[k - 1];
+        }
+    });
+}
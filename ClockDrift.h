@@ -0,0 +1,54 @@
+/**
+ * @file ClockDrift.h
+ * @brief offset and skew of the clock of a camera against a reference camera
+ *
+ * The clocks of the mcams do not tick at exactly the same rate, over long
+ * recordings their timestamps drift apart by more than the sync tolerance.
+ * The clock of a camera is modelled piecewise: for every window of its own
+ * time a line offset + skew * (t - start) maps its timestamps onto the
+ * reference clock. Each window is fitted to the reference frames nearest to
+ * the timestamps predicted by the window before it, with outliers rejected,
+ * so the model follows drift of any length. Cameras may run at another frame
+ * rate than the reference, only mutually nearest frames are paired.
+ */
+#ifndef __CLOCK_DRIFT_H__
+#define __CLOCK_DRIFT_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+struct TimeStampTable;
+
+struct ClockSegment {
+    uint64_t start;     //!< first timestamp of the window on the camera clock
+    double offset;      //!< reference time - camera time at start in us
+    double skew;        //!< change of the offset per us of camera time
+};
+
+struct ClockFit {
+    std::vector<ClockSegment> segments;
+    uint64_t pairs;     //!< frames matched to reference frames
+    double rms;         //!< rms of the fit residuals in us
+    double maxResidual; //!< largest residual of a matched frame in us
+};
+
+/**
+ * @brief fit the clock of a camera against the reference camera
+ * @param window length of a window in us of camera time
+ * @param tolerance largest distance of a matched reference frame from its predicted time
+ */
+void fitClock(const uint64_t* timeStamps, size_t frames, const uint64_t* reference, size_t referenceFrames,
+    uint64_t window, uint64_t tolerance, ClockFit& fit);
+
+/** @brief timestamp on the reference clock */
+uint64_t correctTimeStamp(const ClockFit& fit, uint64_t timeStamp);
+
+/**
+ * @brief fit the clock of every camera against the reference camera and map
+ *        all timestamps onto the reference clock, cameras are fitted in parallel
+ */
+void correctClocks(const TimeStampTable& timeStamps, int reference, uint64_t window, uint64_t tolerance,
+    int threads, std::vector<ClockFit>& fits, TimeStampTable& corrected);
+
+#endif // __CLOCK_DRIFT_H__
@@ -1,147 +1,503 @@
+/******************************************************************************
+ *
+ * CutH264Stream.cpp
+ *
+ * Cut a recorded mcam stream so it starts with its first I frame: the frames
+ * before it are skipped, the stream from the I frame on is copied and the
+ * matching records of the metadata sidecar are written to a binary and a
+ * text file. The I frame is the first frame holding an IDR slice (an IRAP
+ * slice for h265 streams, the codec is detected from the first frames).
+ * The stream is read in a single pass, only the frames before the I frame
+ * are looked at and the tail is copied in the kernel with copy_file_range
+ * (or sendfile) so its bytes never come into userspace.
+ *
+ * In batch mode all cameras of one or more session directories are cut in
+ * parallel, on as many threads as the storage of the first session serves
+ * well unless -j is given. With -i the cameras are cut in place, the leading
+ * bytes are collapsed out of the stream files where the file system
+ * supports it, which takes no time compared to copying the stream.
+ *
+ *****************************************************************************/
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <unistd.h>
-#include <math.h>
-#include <sstream>
-#include <iostream>
-#include <fstream>
-#include "mantis/MantisAPI.h"
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
 #include <string>
 #include <vector>
-#include <mutex>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "mantis/MantisAPI.h"
+#include "NalParser.h"
+#include "SessionFiles.h"
+#include "ThreadPool.h"
+#include "CRC32C.h"
+#include "FileCopy.h"
 
-int findIframePosition(std::string metafile) {
-    FILE *fpmeta;
-    // open meta file for read
-    fpmeta = fopen(metafile.c_str(), "rb");
-    FRAME_METADATA frameInfo;
-    int result;
+// frames before the I frame are only read up to this size
+#define CUT_BUFFER_SIZE (4 << 20)
 
-    int IframeInd = 0;
-    unsigned int maxFrameSize = 0;
+struct CutResult {
+    int codec;
+    int frames;             // frames written
+    int skipped;            // frames before the I frame
+    bool truncated;         // the stream ends within a frame listed in the metadata
+    uint64_t bytes;         // stream bytes written
+};
 
-    for(int i = 0; i < 30; i ++) {
-        result = fread(&frameInfo, 1, sizeof(frameInfo), fpmeta);
-        if (result != sizeof(frameInfo))
-            break;
-        if (frameInfo.m_size > maxFrameSize) {
-            IframeInd = i;
-            maxFrameSize = frameInfo.m_size;
-        }
+/**
+ * @brief the frames of a stream from its first I frame on
+ */
+struct CutScan {
+    int codec;
+    bool found;             // an I frame was found
+    bool truncated;         // the stream ends within a frame listed in the metadata
+    int skipped;            // frames before the I frame
+    uint64_t cutOffset;     // stream offset of the I frame
+    uint64_t endOffset;     // stream offset after the last complete frame
+    std::vector<FRAME_METADATA> frames;
+};
 
-    }
-    fclose(fpmeta);
-    printf("Frame index %d is an I frame!\n", IframeInd);
-    return IframeInd;
-}
+/**
+ * @brief walk the metadata once, parse the frames up to the first I frame
+ *        and collect the records of the frames from there on
+ */
+static int scanStream(int fdh264, FILE* fpmeta, const std::string& h264file, std::vector<uint8_t>& buffer,
+    CutScan& scan, bool verbose) {
+    struct stat st;
+    fstat(fdh264, &st);
+    uint64_t streamSize = st.st_size;
+    scan.codec = CODEC_UNKNOWN;
+    scan.found = false;
+    scan.truncated = false;
+    scan.skipped = 0;
+    scan.cutOffset = 0;
+    scan.frames.clear();
 
-int findIframePosition2(std::string h264file, std::string metafile) {
-    FILE *fpmeta, *fph264;
-    // open meta file for read
-    fpmeta = fopen(metafile.c_str(), "rb");
-    fph264 = fopen(h264file.c_str(), "rb");
+    FrameNals nals;
     FRAME_METADATA frameInfo;
-    int result;
-    char* data;
-    int IframeInd = 0;
+    uint64_t offset = 0;        // stream offset of the current frame
     int ind = 0;
-    for(;;) {
-        result = fread(&frameInfo, 1, sizeof(frameInfo), fpmeta);
-        if (result != sizeof(frameInfo))
+    while (fread(&frameInfo, 1, sizeof(frameInfo), fpmeta) == sizeof(frameInfo)) {
+        if (offset + frameInfo.m_size > streamSize) {
+            scan.truncated = true;
             break;
-        data = new char[frameInfo.m_size];
-        if(!fread(data, 1, frameInfo.m_size, fph264)) {
-            printf("Read h264 stream file failed.\n");
-            exit(-1);
         }
-        if (data[4] == 0x67 and data[5] == 0x64) {
-            IframeInd = ind;
-            break;
+        if (!scan.found) {
+            size_t size = std::min<size_t>(frameInfo.m_size, buffer.size());
+            if (pread(fdh264, &buffer[0], size, offset) != (ssize_t)size) {
+                printf("Read h264 stream file failed.\n");
+                scan.truncated = true;
+                break;
+            }
+            if (scan.codec == CODEC_UNKNOWN) {
+                scan.codec = detectCodec(&buffer[0], size);
+                if (scan.codec != CODEC_UNKNOWN && verbose)
+                    printf("Stream %s is %s\n", h264file.c_str(), codecName(scan.codec));
+            }
+            parseFrame(&buffer[0], size, scan.codec, nals);
+            if (nals.frameType == FRAME_IDR) {
+                if (verbose)
+                    printf("Frame index %d is an I frame!\n", ind);
+                scan.found = true;
+                scan.cutOffset = offset;
+            }
+            else scan.skipped++;
         }
-        delete[] data;
+        if (scan.found)
+            scan.frames.push_back(frameInfo);
+        offset += frameInfo.m_size;
         ind ++;
     }
-    fclose(fph264);
-    fclose(fpmeta);
-    printf("Frame index %d is an I frame!\n", IframeInd);
-    return IframeInd;
+    scan.endOffset = offset;
+    if (scan.truncated)
+        printf("Stream %s ends within frame %d, the frame and the following ones are dropped\n",
+            h264file.c_str(), ind);
+    if (!scan.found)
+        printf("No I frame in %s!\n", h264file.c_str());
+    return 0;
 }
 
-int cutHEVCStream(std::string h264file, std::string h264file_out, 
-    std::string metafile, std::string metafile_out, std::string metafile_out_txt, int IframeInd) {
-    // std::string h264file = "/media/data/project/AquetiCameraRecord/data/1/mcam_7001";
-    // std::string h264file_out = "/media/data/project/AquetiCameraRecord/data/1/mcam_7001_cut";
-    // std::string metafile = "/media/data/project/AquetiCameraRecord/data/1/mcam_config_7001";
-    // std::string metafile_out = "/media/data/project/AquetiCameraRecord/data/1/mcam_config_7001_cut";
+static int writeMetaFiles(const std::string& metafile_out, const std::string& metafile_out_txt,
+    const std::vector<FRAME_METADATA>& frames) {
+    FILE* fpmeta_out = fopen(metafile_out.c_str(), "wb");
+    FILE* fpmeta_out_txt = fopen(metafile_out_txt.c_str(), "w");
+    if (fpmeta_out == NULL || fpmeta_out_txt == NULL) {
+        printf("Open output files %s, %s failed!\n", metafile_out.c_str(), metafile_out_txt.c_str());
+        if (fpmeta_out) fclose(fpmeta_out);
+        if (fpmeta_out_txt) fclose(fpmeta_out_txt);
+        return -1;
+    }
+    if (!frames.empty())
+        fwrite(&frames[0], sizeof(FRAME_METADATA), frames.size(), fpmeta_out);
+    for (size_t i = 0; i < frames.size(); i ++)
+        fprintf(fpmeta_out_txt, "%lu\t%zu\t%llu\n", i, frames[i].m_size, frames[i].m_timestamp);
+    int ret = ferror(fpmeta_out) ? -1 : 0;
+    if (fclose(fpmeta_out) != 0)
+        ret = -1;
+    fclose(fpmeta_out_txt);
+    return ret;
+}
 
-    FILE *fph264, *fph264_out, *fpmeta, *fpmeta_out, *fpmeta_out_txt;
+int cutH264Stream(const std::string& h264file, const std::string& h264file_out,
+    const std::string& metafile, const std::string& metafile_out, const std::string& metafile_out_txt,
+    CutResult& result, std::atomic<uint64_t>* progress, bool verbose) {
+    memset(&result, 0, sizeof(result));
+    int fdh264 = open(h264file.c_str(), O_RDONLY);
+    FILE* fpmeta = fopen(metafile.c_str(), "rb");
+    if (fdh264 < 0 || fpmeta == NULL) {
+        printf("Open input files %s, %s failed!\n", h264file.c_str(), metafile.c_str());
+        if (fdh264 >= 0) close(fdh264);
+        if (fpmeta) fclose(fpmeta);
+        return -1;
+    }
+    posix_fadvise(fdh264, 0, 0, POSIX_FADV_SEQUENTIAL);
+    int fdh264_out = open(h264file_out.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fdh264_out < 0) {
+        printf("Open output file %s failed!\n", h264file_out.c_str());
+        close(fdh264);
+        fclose(fpmeta);
+        return -1;
+    }
 
-    // open meta file for read
-    fpmeta = fopen(metafile.c_str(), "rb");
-    FRAME_METADATA frameInfo;
-    // open h264 stream file for read
-    fph264 = fopen(h264file.c_str(), "rb");
-    char* data;
+    std::vector<uint8_t> buffer(CUT_BUFFER_SIZE);
+    CutScan scan;
+    scanStream(fdh264, fpmeta, h264file, buffer, scan, verbose);
+    int ret = writeMetaFiles(metafile_out, metafile_out_txt, scan.frames);
+    if (scan.found) {
+        uint64_t length = scan.endOffset - scan.cutOffset;
+        result.bytes = copyRange(fdh264, scan.cutOffset, fdh264_out, length, buffer, progress);
+        if (result.bytes != length) {
+            printf("Copy h264 stream %s failed: %s\n", h264file.c_str(), strerror(errno));
+            ret = -1;
+        }
+    }
+    close(fdh264);
+    fclose(fpmeta);
+    close(fdh264_out);
 
-    // open meta file for write
-    fpmeta_out = fopen(metafile_out.c_str(), "wb");
-    // open h264 stream file for write
-    fph264_out = fopen(h264file_out.c_str(), "wb");
+    result.codec = scan.codec;
+    result.frames = (int)scan.frames.size();
+    result.skipped = scan.skipped;
+    result.truncated = scan.truncated;
+    if (verbose)
+        printf("Cut video finished, total %d frames!\n", result.frames);
+    return ret;
+}
 
-    // open text meta file for write
-    fpmeta_out_txt = fopen(metafile_out_txt.c_str(), "w");
+/**
+ * @brief rewrite the checksum sidecar for the cut stream: drop the records of
+ *        the skipped frames and of a truncated tail, recompute the first frame
+ */
+static int cutChecksums(const std::string& crcfile, int fdh264, const CutScan& scan,
+    std::vector<uint8_t>& buffer) {
+    FILE* fp = fopen(crcfile.c_str(), "rb");
+    if (fp == NULL)
+        return 0;
+    std::vector<FrameChecksum> checksums;
+    FrameChecksum checksum;
+    while (fread(&checksum, 1, sizeof(checksum), fp) == sizeof(checksum))
+        checksums.push_back(checksum);
+    fclose(fp);
+    if (checksums.size() > (size_t)scan.skipped)
+        checksums.erase(checksums.begin(), checksums.begin() + scan.skipped);
+    else checksums.clear();
+    if (checksums.size() > scan.frames.size())
+        checksums.resize(scan.frames.size());
+    if (!checksums.empty()) {
+        // the first frame may have gained leading zeros, the rest is unchanged
+        const FRAME_METADATA& first = scan.frames[0];
+        uint32_t crc = 0;
+        for (uint64_t done = 0; done < first.m_size; ) {
+            size_t n = (size_t)std::min<uint64_t>(first.m_size - done, buffer.size());
+            if (pread(fdh264, &buffer[0], n, done) != (ssize_t)n)
+                return -1;
+            crc = crc32c(crc, &buffer[0], n);
+            done += n;
+        }
+        checksums[0].data = crc;
+        checksums[0].meta = crc32c(0, &first, sizeof(first));
+    }
+    std::string tmpfile = crcfile + ".tmp";
+    fp = fopen(tmpfile.c_str(), "wb");
+    if (fp == NULL)
+        return -1;
+    if (!checksums.empty())
+        fwrite(&checksums[0], sizeof(FrameChecksum), checksums.size(), fp);
+    if (fclose(fp) != 0)
+        return -1;
+    return rename(tmpfile.c_str(), crcfile.c_str());
+}
 
-    int result;
-    int ind = 0;
-    int valid_frame_num = 0;
-    bool hasIframe = false;
-    for(;;) {
-        result = fread(&frameInfo, 1, sizeof(frameInfo), fpmeta);
-        if (result != sizeof(frameInfo))
-            break;
-        printf("%d\t%zu\t%llu\n", ind, frameInfo.m_size, frameInfo.m_timestamp);
+/**
+ * @brief cut a camera of a session in place: the block aligned part of the
+ *        bytes before the I frame is collapsed out of the stream file, the
+ *        rest is overwritten with zeros, which an Annex-B stream allows in
+ *        front of a start code (leading_zero_8bits), and counted to the first
+ *        frame. Without FALLOC_FL_COLLAPSE_RANGE support the tail is copied
+ *        to a new file that replaces the stream.
+ */
+int cutInPlace(const std::string& dir, uint32_t mcamId, CutResult& result, std::atomic<uint64_t>* progress,
+    bool verbose) {
+    memset(&result, 0, sizeof(result));
+    std::string h264file = streamFileName(dir, mcamId);
+    std::string metafile = metaFileName(dir, mcamId);
+    int fdh264 = open(h264file.c_str(), O_RDWR);
+    FILE* fpmeta = fopen(metafile.c_str(), "rb");
+    if (fdh264 < 0 || fpmeta == NULL) {
+        printf("Open input files %s, %s failed!\n", h264file.c_str(), metafile.c_str());
+        if (fdh264 >= 0) close(fdh264);
+        if (fpmeta) fclose(fpmeta);
+        return -1;
+    }
+    std::vector<uint8_t> buffer(CUT_BUFFER_SIZE);
+    CutScan scan;
+    scanStream(fdh264, fpmeta, h264file, buffer, scan, verbose);
+    fclose(fpmeta);
+    result.codec = scan.codec;
+    result.frames = (int)scan.frames.size();
+    result.skipped = scan.skipped;
+    result.truncated = scan.truncated;
+    if (!scan.found || (scan.cutOffset == 0 && !scan.truncated)) {
+        close(fdh264);
+        return 0;
+    }
 
-        data = new char[frameInfo.m_size];
-        if(!fread(data, 1, frameInfo.m_size, fph264)) {
-            printf("Read h264 stream file failed.\n");
-            exit(-1);
+    struct stat st;
+    fstat(fdh264, &st);
+    uint64_t block = st.st_blksize > 0 ? st.st_blksize : 4096;
+    uint64_t collapse = scan.cutOffset / block * block;
+    uint64_t length = scan.endOffset - scan.cutOffset;
+    int ret = 0;
+    // the collapsed range must end before the end of the file
+    if (collapse > 0 && collapse < (uint64_t)st.st_size &&
+        fallocate(fdh264, FALLOC_FL_COLLAPSE_RANGE, 0, collapse) == 0) {
+        uint64_t padding = scan.cutOffset - collapse;
+        memset(&buffer[0], 0, padding);
+        if (padding > 0 && pwrite(fdh264, &buffer[0], padding, 0) != (ssize_t)padding)
+            ret = -1;
+        if (ftruncate(fdh264, scan.endOffset - collapse) != 0)
+            ret = -1;
+        scan.frames[0].m_size += padding;
+        result.bytes = length + padding;
+        if (progress)
+            *progress += result.bytes;
+        if (verbose)
+            printf("Collapsed %llu bytes, %llu bytes of padding\n", (unsigned long long)collapse,
+                (unsigned long long)padding);
+    }
+    else if (scan.cutOffset == 0) {
+        // only a truncated tail to drop
+        if (ftruncate(fdh264, scan.endOffset) != 0)
+            ret = -1;
+        result.bytes = length;
+    }
+    else {
+        if (verbose)
+            printf("Collapse range is not supported for %s, copying\n", h264file.c_str());
+        std::string tmpfile = h264file + ".tmp";
+        int fdtmp = open(tmpfile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fdtmp < 0) {
+            printf("Open output file %s failed!\n", tmpfile.c_str());
+            close(fdh264);
+            return -1;
         }
-
-        if (!hasIframe && ind == IframeInd) {
-            printf("Frame index %d is an I frame!\n", ind);
-            hasIframe = true;
+        result.bytes = copyRange(fdh264, scan.cutOffset, fdtmp, length, buffer, progress);
+        if (close(fdtmp) != 0 || result.bytes != length || rename(tmpfile.c_str(), h264file.c_str()) != 0) {
+            printf("Copy h264 stream %s failed: %s\n", h264file.c_str(), strerror(errno));
+            unlink(tmpfile.c_str());
+            close(fdh264);
+            return -1;
         }
+        close(fdh264);
+        fdh264 = open(h264file.c_str(), O_RDONLY);
+    }
 
-        if (hasIframe) {
-            fwrite(data, frameInfo.m_size, 1, fph264_out);
-            fwrite(&frameInfo, sizeof(frameInfo), 1, fpmeta_out);
-            fprintf(fpmeta_out_txt, "%d\t%zu\t%llu\n", valid_frame_num, frameInfo.m_size, frameInfo.m_timestamp);
-            valid_frame_num++;
-        }
-        delete[] data;
+    std::string tmpfile = metafile + ".tmp";
+    if (writeMetaFiles(tmpfile, metafile + ".txt", scan.frames) != 0 ||
+        rename(tmpfile.c_str(), metafile.c_str()) != 0)
+        ret = -1;
+    if (cutChecksums(checksumFileName(dir, mcamId), fdh264, scan, buffer) != 0) {
+        printf("Update checksums of %s failed!\n", h264file.c_str());
+        ret = -1;
+    }
+    // the frame index no longer matches, it is built again on first use
+    unlink(indexFileName(dir, mcamId).c_str());
+    close(fdh264);
+    if (verbose)
+        printf("Cut video finished, total %d frames!\n", result.frames);
+    return ret;
+}
 
-        ind ++;
+/**
+ * @brief threads that keep the storage holding dir busy: a few for spinning
+ *        disks, one per core (up to 16) for ssd/nvme and unknown devices
+ */
+static int storageThreads(const std::string& dir) {
+    int cores = (int)std::thread::hardware_concurrency();
+    cores = std::max(1, std::min(cores, 16));
+    struct stat st;
+    if (stat(dir.c_str(), &st) != 0)
+        return cores;
+    char path[128];
+    sprintf(path, "/sys/dev/block/%u:%u", major(st.st_dev), minor(st.st_dev));
+    // partitions keep their queue attributes in the parent device
+    std::string device = path;
+    FILE* fp = fopen((device + "/queue/rotational").c_str(), "r");
+    if (fp == NULL)
+        fp = fopen((device + "/../queue/rotational").c_str(), "r");
+    int rotational = 0;
+    if (fp) {
+        if (fscanf(fp, "%d", &rotational) != 1)
+            rotational = 0;
+        fclose(fp);
+    }
+    return rotational ? std::min(cores, 2) : cores;
+}
 
+struct CutJob {
+    std::string inDir;
+    std::string outDir;         // empty to cut in place
+    uint32_t mcamId;
+    int ret;
+    CutResult result;
+};
+
+/**
+ * @brief cut every camera of the sessions into outDir, or into
+ *        outDir/<session name> when there is more than one session,
+ *        an empty outDir cuts the sessions in place
+ */
+int cutSessions(const std::vector<std::string>& sessions, const std::string& outDir, int threads) {
+    if (!outDir.empty())
+        mkdir(outDir.c_str(), 0755);
+    std::vector<CutJob> jobs;
+    uint64_t totalBytes = 0;
+    for (size_t s = 0; s < sessions.size(); s ++) {
+        std::string out = outDir;
+        if (!outDir.empty() && sessions.size() > 1) {
+            std::string name = sessions[s];
+            while (name.size() > 1 && name[name.size() - 1] == '/')
+                name.erase(name.size() - 1);
+            size_t slash = name.rfind('/');
+            out = outDir + "/" + (slash == std::string::npos ? name : name.substr(slash + 1));
+            mkdir(out.c_str(), 0755);
+        }
+        std::vector<uint32_t> ids = listCameras(sessions[s]);
+        if (ids.empty())
+            printf("No recorded camera in %s!\n", sessions[s].c_str());
+        for (size_t i = 0; i < ids.size(); i ++) {
+            CutJob job;
+            job.inDir = sessions[s];
+            job.outDir = out;
+            job.mcamId = ids[i];
+            job.ret = -1;
+            memset(&job.result, 0, sizeof(job.result));
+            jobs.push_back(job);
+            struct stat st;
+            if (stat(streamFileName(sessions[s], ids[i]).c_str(), &st) == 0)
+                totalBytes += st.st_size;
+        }
     }
+    if (jobs.empty())
+        return -1;
+    if (threads <= 0)
+        threads = storageThreads(sessions[0]);
+    printf("Cut %lu cameras of %lu sessions (%.2f GB) on %d threads\n", jobs.size(), sessions.size(),
+        totalBytes / 1e9, threads);
 
-    fclose(fph264);
-    fclose(fpmeta);
-    fclose(fph264_out);
-    fclose(fpmeta_out);
-    fclose(fpmeta_out_txt);
+    std::atomic<uint64_t> copied(0);
+    std::atomic<size_t> finished(0);
+    std::atomic<bool> done(false);
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    std::thread progress([&]() {
+        uint64_t lastBytes = 0;
+        std::chrono::steady_clock::time_point last = begin;
+        while (!done) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            double seconds = std::chrono::duration<double>(now - last).count();
+            if (seconds < 1.0 || done)
+                continue;
+            uint64_t bytes = copied;
+            printf("Progress: %lu/%lu cameras, %.2f/%.2f GB, %.1f MB/s\n", finished.load(), jobs.size(),
+                bytes / 1e9, totalBytes / 1e9, (bytes - lastBytes) / seconds / 1e6);
+            fflush(stdout);
+            lastBytes = bytes;
+            last = now;
+        }
+    });
+    parallelFor(jobs.size(), threads, [&](size_t i) {
+        CutJob& job = jobs[i];
+        if (job.outDir.empty()) {
+            job.ret = cutInPlace(job.inDir, job.mcamId, job.result, &copied, false);
+            finished++;
+            return;
+        }
+        std::string metaOut = metaFileName(job.outDir, job.mcamId);
+        job.ret = cutH264Stream(streamFileName(job.inDir, job.mcamId), streamFileName(job.outDir, job.mcamId),
+            metaFileName(job.inDir, job.mcamId), metaOut, metaOut + ".txt", job.result, &copied, false);
+        finished++;
+    });
+    done = true;
+    progress.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
 
-    printf("Cut video finished, total %d frames!\n", valid_frame_num);
+    int failed = 0;
+    uint64_t written = 0;
+    for (size_t i = 0; i < jobs.size(); i ++) {
+        const CutJob& job = jobs[i];
+        printf("%s camera %u (%s): %s, skipped %d frames, wrote %d frames, %.1f MB%s\n", job.inDir.c_str(),
+            job.mcamId, codecName(job.result.codec), job.ret == 0 ? "ok" : "FAILED", job.result.skipped,
+            job.result.frames, job.result.bytes / 1e6, job.result.truncated ? ", stream truncated" : "");
+        failed += job.ret != 0;
+        written += job.result.bytes;
+    }
+    printf("Cut %lu cameras, %d failed, wrote %.2f GB in %.1f s, %.1f MB/s\n", jobs.size(), failed,
+        written / 1e9, seconds, seconds > 0 ? written / seconds / 1e6 : 0.0);
+    return failed ? -1 : 0;
+}
 
-    return 0;
+void printHelp() {
+    printf("Cut recorded streams so they start with the first I frame\n");
+    printf("Usage: CutH264Stream <h264 in> <h264 out> <meta in> <meta out> <meta out txt>\n");
+    printf("       CutH264Stream -o <out dir> [-j threads] <session dir> [session dir ...]\n");
+    printf("       CutH264Stream -i [-j threads] <session dir> [session dir ...]\n");
+    printf("\t-o <out dir> output directory, one sub directory per session when several are given\n");
+    printf("\t-i cut the sessions in place, also updates the checksum sidecars\n");
+    printf("\t-j <threads> cameras cut in parallel (default: by storage type and cores)\n");
 }
 
 int main(int argc, char* argv[]) {
-    //int IframeInd1 = findIframePosition(argv[3]);
-    //int IframeInd2 = findIframePosition2(argv[1], argv[3]);
-    //printf("Method 1, I frame is %d, Method 2, I frame is %d\n", IframeInd1, IframeInd2);
-
-    int IframeInd = findIframePosition2(argv[1], argv[3]);
-    cutHEVCStream(argv[1], argv[2], argv[3], argv[4], argv[5], IframeInd);
-    return 0;
-}
\ No newline at end of file
+    if (argc > 1 && (strcmp(argv[1], "-o") == 0 || strcmp(argv[1], "-j") == 0 || strcmp(argv[1], "-i") == 0)) {
+        std::string outDir;
+        bool inPlace = false;
+        int threads = 0;
+        std::vector<std::string> sessions;
+        for (int i = 1; i < argc; i ++) {
+            if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+                outDir = argv[++i];
+            else if (strcmp(argv[i], "-i") == 0)
+                inPlace = true;
+            else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+                threads = atoi(argv[++i]);
+            else sessions.push_back(argv[i]);
+        }
+        if (outDir.empty() == !inPlace || sessions.empty()) {
+            printHelp();
+            return -1;
+        }
+        return cutSessions(sessions, outDir, threads) == 0 ? 0 : -1;
+    }
+    if (argc < 6) {
+        printHelp();
+        return argc > 1 && strcmp(argv[1], "-h") == 0 ? 0 : -1;
+    }
+    CutResult result;
+    return cutH264Stream(argv[1], argv[2], argv[3], argv[4], argv[5], result, NULL, true) == 0 ? 0 : -1;
+}
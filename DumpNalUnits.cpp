@@ -0,0 +1,121 @@
+/******************************************************************************
+ *
+ * DumpNalUnits.cpp
+ *
+ * Print the NAL units of every frame of a recorded h264 or h265 mcam stream,
+ * one frame per line: frame index, size, timestamp, frame type and the NAL
+ * units with their sizes. A summary of frame and NAL unit counts, GOP lengths and the
+ * parse throughput follows.
+ *
+ *****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <chrono>
+#include "mantis/MantisAPI.h"
+#include "SessionFiles.h"
+#include "NalParser.h"
+
+void printHelp() {
+    printf("Print the NAL units of the frames of a recorded stream\n");
+    printf("Usage: DumpNalUnits <session dir> <mcam id> [-s]\n");
+    printf("\t-s print the summary only\n");
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3 || strcmp(argv[1], "-h") == 0) {
+        printHelp();
+        return argc < 3 ? -1 : 0;
+    }
+    std::string dir = argv[1];
+    uint32_t mcamId = atoi(argv[2]);
+    bool summaryOnly = argc > 3 && strcmp(argv[3], "-s") == 0;
+
+    FILE* fpmeta = fopen(metaFileName(dir, mcamId).c_str(), "rb");
+    FILE* fph264 = fopen(streamFileName(dir, mcamId).c_str(), "rb");
+    if (fpmeta == NULL || fph264 == NULL) {
+        printf("Open stream files of camera %u in %s failed!\n", mcamId, dir.c_str());
+        if (fpmeta) fclose(fpmeta);
+        if (fph264) fclose(fph264);
+        return -1;
+    }
+    setvbuf(fph264, NULL, _IOFBF, 4 << 20);
+
+    std::vector<uint8_t> data(1 << 20);
+    FrameNals nals;
+    int codec = CODEC_UNKNOWN;
+    FRAME_METADATA frameInfo;
+    uint64_t frames = 0;
+    uint64_t bytes = 0;
+    uint64_t frameTypes[3] = {0, 0, 0};
+    uint64_t nalTypes[64];
+    memset(nalTypes, 0, sizeof(nalTypes));
+    uint64_t shortStartCodes = 0;
+    uint64_t idrWithoutParameterSets = 0;
+    uint64_t lastIdr = 0;
+    uint64_t gops = 0;
+    uint64_t minGop = 0;
+    uint64_t maxGop = 0;
+    double parseSeconds = 0;
+    while (fread(&frameInfo, 1, sizeof(frameInfo), fpmeta) == sizeof(frameInfo)) {
+        if (frameInfo.m_size > data.size())
+            data.resize(frameInfo.m_size);
+        if (fread(&data[0], 1, frameInfo.m_size, fph264) != frameInfo.m_size) {
+            printf("Stream ends within frame %llu\n", (unsigned long long)frames);
+            break;
+        }
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        if (codec == CODEC_UNKNOWN)
+            codec = detectCodec(&data[0], frameInfo.m_size);
+        parseFrame(&data[0], frameInfo.m_size, codec, nals);
+        parseSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+        frameTypes[nals.frameType]++;
+        for (size_t i = 0; i < nals.units.size(); i ++) {
+            nalTypes[nals.units[i].type]++;
+            if (nals.units[i].startCode == 3)
+                shortStartCodes++;
+        }
+        if (nals.frameType == FRAME_IDR) {
+            if (!nals.hasSps || !nals.hasPps || (codec == CODEC_HEVC && !nals.hasVps))
+                idrWithoutParameterSets++;
+            if (frameTypes[FRAME_IDR] > 1) {
+                uint64_t gop = frames - lastIdr;
+                minGop = gops == 0 || gop < minGop ? gop : minGop;
+                maxGop = gop > maxGop ? gop : maxGop;
+                gops++;
+            }
+            lastIdr = frames;
+        }
+        if (!summaryOnly) {
+            printf("%llu\t%zu\t%llu\t%s\t", (unsigned long long)frames, frameInfo.m_size,
+                (unsigned long long)frameInfo.m_timestamp, frameTypeName(nals.frameType));
+            for (size_t i = 0; i < nals.units.size(); i ++)
+                printf("%s%s(%zu)", i ? " " : "", nalTypeName(codec, nals.units[i].type), nals.units[i].size);
+            printf("\n");
+        }
+        frames++;
+        bytes += frameInfo.m_size;
+    }
+    fclose(fpmeta);
+    fclose(fph264);
+
+    printf("Camera %u (%s): %llu frames, %llu bytes, %llu IDR, %llu non-IDR, %llu without slice\n", mcamId,
+        codecName(codec), (unsigned long long)frames, (unsigned long long)bytes,
+        (unsigned long long)frameTypes[FRAME_IDR], (unsigned long long)frameTypes[FRAME_NON_IDR],
+        (unsigned long long)frameTypes[FRAME_UNKNOWN]);
+    printf("NAL units:");
+    for (int t = 0; t < 64; t ++)
+        if (nalTypes[t])
+            printf(" %s(%d) %llu", nalTypeName(codec, t), t, (unsigned long long)nalTypes[t]);
+    printf(", %llu after 3 byte start codes\n", (unsigned long long)shortStartCodes);
+    if (gops > 0)
+        printf("GOP length: min %llu, max %llu frames\n", (unsigned long long)minGop, (unsigned long long)maxGop);
+    if (idrWithoutParameterSets)
+        printf("%llu IDR frames without parameter sets\n", (unsigned long long)idrWithoutParameterSets);
+    printf("Parsed with %s start code scan at %.1f MB/s\n", startCodeScanImplementation(),
+        parseSeconds > 0 ? bytes / parseSeconds / 1e6 : 0.0);
+    return 0;
+}
@@ -0,0 +1,46 @@
+/******************************************************************************
+ *
+ * DumpPropertyLog.cpp
+ *
+ * Print the property_log of a recorded session as a tab separated table:
+ * host time (us), frame timestamp, mcam id, property, value(s).
+ *
+ *****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include "SessionFiles.h"
+
+void printHelp() {
+    printf("Print the camera property changes of a recorded session\n");
+    printf("Usage: DumpPropertyLog <session dir> [mcam id]\n");
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2 || strcmp(argv[1], "-h") == 0) {
+        printHelp();
+        return argc < 2 ? -1 : 0;
+    }
+    uint32_t mcamId = argc > 2 ? atoi(argv[2]) : 0;
+    std::string fileName = propertyLogFileName(argv[1]);
+    FILE* fp = fopen(fileName.c_str(), "rb");
+    if (fp == NULL) {
+        printf("Open property log %s failed!\n", fileName.c_str());
+        return -1;
+    }
+    PropertyRecord record;
+    while (fread(&record, 1, sizeof(record), fp) == sizeof(record)) {
+        if (mcamId != 0 && record.mcamId != mcamId)
+            continue;
+        printf("%llu\t%llu\t%u\t%s%s\t", (unsigned long long)record.time,
+            (unsigned long long)record.timestamp, record.mcamId, propertyName(record.property),
+            record.initial ? "(initial)" : "");
+        if (record.property == PROPERTY_WHITE_BALANCE)
+            printf("%f\t%f\t%f\n", record.value[0], record.value[1], record.value[2]);
+        else
+            printf("%f\n", record.value[0]);
+    }
+    fclose(fp);
+    return 0;
+}
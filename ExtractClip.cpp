@@ -0,0 +1,182 @@
+/******************************************************************************
+ *
+ * ExtractClip.cpp
+ *
+ * Extract the frames of a recorded session between two sensor timestamps
+ * into a new session directory. The clip of each camera starts at the last
+ * I frame at or before t_start, so it can be decoded from its first frame,
+ * and ends with the last frame at or before t_end. Frames are found by
+ * binary search on the timestamps of the frame index of the camera, so the
+ * stream is never scanned from its beginning. The stream bytes, metadata and
+ * checksum records of the clip are copied in the kernel and the clip gets a
+ * frame index of its own. Cameras are extracted in parallel.
+ *
+ *****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include "mantis/MantisAPI.h"
+#include "SessionFiles.h"
+#include "FrameIndex.h"
+#include "NalParser.h"
+#include "ThreadPool.h"
+#include "FileCopy.h"
+
+struct ClipJob {
+    uint32_t mcamId;
+    int ret;
+    int codec;
+    size_t first;           // first frame of the clip
+    size_t frames;
+    uint64_t firstTimestamp;
+    uint64_t bytes;
+};
+
+/**
+ * @brief copy records [first, first + count) of a sidecar with fixed size records
+ * @return 0 on success, 1 if the sidecar does not exist
+ */
+static int copyRecords(const std::string& in, const std::string& out, size_t recordSize, size_t first,
+    size_t count, std::vector<uint8_t>& buffer) {
+    int fdin = open(in.c_str(), O_RDONLY);
+    if (fdin < 0)
+        return 1;
+    int fdout = open(out.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fdout < 0) {
+        printf("Open output file %s failed!\n", out.c_str());
+        close(fdin);
+        return -1;
+    }
+    uint64_t length = (uint64_t)count * recordSize;
+    int ret = copyRange(fdin, (uint64_t)first * recordSize, fdout, length, buffer, NULL) == length ? 0 : -1;
+    if (ret != 0)
+        printf("Copy %s failed: %s\n", in.c_str(), strerror(errno));
+    close(fdin);
+    close(fdout);
+    return ret;
+}
+
+static int extractCamera(const std::string& inDir, const std::string& outDir, uint64_t tStart, uint64_t tEnd,
+    ClipJob& job, std::atomic<uint64_t>* progress) {
+    FrameIndex index;
+    if (index.open(inDir, job.mcamId) != 0)
+        return -1;
+    size_t end = index.upperFrame(tEnd);
+    size_t start = index.lowerBound(tStart);
+    if (start >= index.size() || end >= index.size() || end < start) {
+        printf("Camera %u has no frame between %llu and %llu\n", job.mcamId, (unsigned long long)tStart,
+            (unsigned long long)tEnd);
+        return 1;
+    }
+    size_t first = index.keyframeAtOrBefore(start);
+    if (first >= index.size())
+        first = index.keyframeAtOrAfter(start);
+    job.codec = index.codec();
+    if (first > end) {
+        printf("Camera %u has no I frame before %llu\n", job.mcamId, (unsigned long long)tEnd);
+        return 1;
+    }
+    job.first = first;
+    job.frames = end - first + 1;
+    job.firstTimestamp = index[first].timestamp;
+
+    std::string h264file_out = streamFileName(outDir, job.mcamId);
+    int fdh264_out = open(h264file_out.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fdh264_out < 0) {
+        printf("Open output file %s failed!\n", h264file_out.c_str());
+        return -1;
+    }
+    std::vector<uint8_t> buffer(1 << 20);
+    uint64_t length = index[end].offset + index[end].size - index[first].offset;
+    job.bytes = copyRange(index.streamFd(), index[first].offset, fdh264_out, length, buffer, progress);
+    close(fdh264_out);
+    if (job.bytes != length) {
+        printf("Copy h264 stream of camera %u failed: %s\n", job.mcamId, strerror(errno));
+        return -1;
+    }
+    if (copyRecords(metaFileName(inDir, job.mcamId), metaFileName(outDir, job.mcamId), sizeof(FRAME_METADATA),
+        first, job.frames, buffer) != 0)
+        return -1;
+    if (copyRecords(checksumFileName(inDir, job.mcamId), checksumFileName(outDir, job.mcamId),
+        sizeof(FrameChecksum), first, job.frames, buffer) < 0)
+        return -1;
+    if (index.save(indexFileName(outDir, job.mcamId), first, job.frames) != 0) {
+        printf("Write frame index of camera %u failed!\n", job.mcamId);
+        return -1;
+    }
+    return 0;
+}
+
+void printHelp() {
+    printf("Extract the frames between two sensor timestamps of a recorded session\n");
+    printf("Usage: ExtractClip <session dir> <out dir> <t_start> <t_end> [-j threads] [mcam id ...]\n");
+    printf("\tt_start, t_end frame timestamps in microseconds, the clip of each camera\n");
+    printf("\t               starts at the I frame at or before t_start\n");
+    printf("\t-j n           extract n cameras in parallel, default number of cores\n");
+    printf("\tmcam id        cameras to extract, default all cameras of the session\n");
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 5 || strcmp(argv[1], "-h") == 0) {
+        printHelp();
+        return argc < 5 ? -1 : 0;
+    }
+    std::string inDir = argv[1];
+    std::string outDir = argv[2];
+    uint64_t tStart = strtoull(argv[3], NULL, 10);
+    uint64_t tEnd = strtoull(argv[4], NULL, 10);
+    int threads = 0;
+    std::vector<uint32_t> ids;
+    for (int i = 5; i < argc; i ++) {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else ids.push_back(atoi(argv[i]));
+    }
+    if (ids.empty())
+        ids = listCameras(inDir);
+    if (ids.empty()) {
+        printf("No recorded camera in %s!\n", inDir.c_str());
+        return -1;
+    }
+    if (tEnd < tStart) {
+        printf("t_end %llu is before t_start %llu!\n", (unsigned long long)tEnd, (unsigned long long)tStart);
+        return -1;
+    }
+    mkdir(outDir.c_str(), 0755);
+
+    std::vector<ClipJob> jobs(ids.size());
+    for (size_t i = 0; i < ids.size(); i ++) {
+        memset(&jobs[i], 0, sizeof(jobs[i]));
+        jobs[i].mcamId = ids[i];
+    }
+    std::atomic<uint64_t> copied(0);
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    parallelFor(jobs.size(), threads, [&](size_t i) {
+        jobs[i].ret = extractCamera(inDir, outDir, tStart, tEnd, jobs[i], &copied);
+    });
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    int failed = 0;
+    int empty = 0;
+    for (size_t i = 0; i < jobs.size(); i ++) {
+        const ClipJob& job = jobs[i];
+        if (job.ret < 0)
+            failed++;
+        else if (job.ret > 0)
+            empty++;
+        else printf("Camera %u (%s): frames %lu - %lu, %lu frames from %llu, %llu bytes\n", job.mcamId,
+            codecName(job.codec), job.first, job.first + job.frames - 1, job.frames,
+            (unsigned long long)job.firstTimestamp, (unsigned long long)job.bytes);
+    }
+    printf("Extracted %lu cameras (%d empty, %d failed), %.2f GB in %.2f s\n", jobs.size() - failed - empty,
+        empty, failed, copied / 1e9, seconds);
+    return failed ? -1 : 0;
+}
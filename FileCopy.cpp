@@ -0,0 +1,51 @@
+#include "FileCopy.h"
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/sendfile.h>
+#include <algorithm>
+
+// bytes per kernel copy call, bounds the granularity of the progress report
+#define COPY_CHUNK ((size_t)64 << 20)
+
+uint64_t copyRange(int in, uint64_t offset, int out, uint64_t length, std::vector<uint8_t>& buffer,
+    std::atomic<uint64_t>* progress) {
+    uint64_t copied = 0;
+    bool kernelCopy = true;
+    bool sendFile = true;
+    while (copied < length) {
+        size_t chunk = (size_t)std::min<uint64_t>(length - copied, COPY_CHUNK);
+        ssize_t n = -1;
+        if (kernelCopy) {
+            loff_t inOffset = offset;
+            n = copy_file_range(in, &inOffset, out, NULL, chunk, 0);
+            // not supported between these file systems or by this kernel
+            if (n < 0 && (errno == EXDEV || errno == ENOSYS || errno == EINVAL || errno == EOPNOTSUPP)) {
+                kernelCopy = false;
+                continue;
+            }
+        }
+        else if (sendFile) {
+            off_t inOffset = offset;
+            n = sendfile(out, in, &inOffset, chunk);
+            if (n < 0 && (errno == ENOSYS || errno == EINVAL)) {
+                sendFile = false;
+                continue;
+            }
+        }
+        else {
+            n = pread(in, &buffer[0], std::min(chunk, buffer.size()), offset);
+            if (n > 0 && write(out, &buffer[0], n) != n)
+                n = -1;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        copied += n;
+        offset += n;
+        if (progress)
+            *progress += n;
+    }
+    return copied;
+}
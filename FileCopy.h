@@ -0,0 +1,22 @@
+/**
+ * @file FileCopy.h
+ * @brief copy a byte range between files without passing it through userspace
+ */
+#ifndef __FILE_COPY_H__
+#define __FILE_COPY_H__
+
+#include <stdint.h>
+#include <vector>
+#include <atomic>
+
+/**
+ * @brief append length bytes of in starting at offset to out, copy_file_range
+ *        first, then sendfile, then read/write through the buffer
+ * @param buffer used by the read/write fallback, must not be empty
+ * @param progress optional, incremented by the bytes copied
+ * @return bytes copied
+ */
+uint64_t copyRange(int in, uint64_t offset, int out, uint64_t length, std::vector<uint8_t>& buffer,
+    std::atomic<uint64_t>* progress);
+
+#endif // __FILE_COPY_H__
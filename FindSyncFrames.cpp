@@ -1,185 +1,367 @@
+/******************************************************************************
+ *
+ * FindSyncFrames.cpp
+ *
+ * Find the frames of all cameras of a session that were captured together.
+ * The timestamps of every camera are merged with a heap into one time
+ * ordered sequence, O(F log N) for F frames of N cameras, and fed to the
+ * FrameSynchronizer that also groups frames during live capture. Frames that
+ * never complete a group are skipped. The timestamps are loaded in parallel from the mapped sidecars.
+ * The clocks of the cameras drift apart, so unless disabled every camera is
+ * first fitted against a reference camera and the groups are matched on the
+ * corrected timestamps. The sync file keeps the recorded timestamps.
+ * The frame period of every camera comes from its metadata. When the cameras
+ * run at different frame rates every frame of the master camera is matched
+ * with the nearest frame of each other camera instead. The groups are saved
+ * as a binary SyncIndex with the byte offset of every frame in its stream,
+ * the text table is exported on request. With -o the groups are instead
+ * assigned globally: the most groups possible around the master frames,
+ * each with the frames nearest to its master frame that keep all of them.
+ *
+ *****************************************************************************/
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <math.h>
-#include <sstream>
-#include <iostream>
-#include <fstream>
-#include "mantis/MantisAPI.h"
+#include "SessionFiles.h"
+#include "TimeStamps.h"
+#include "ClockDrift.h"
+#include "ThreadPool.h"
+#include "FrameSynchronizer.h"
+#include "FrameIndex.h"
+#include "SyncIndex.h"
+#include "NearestFrames.h"
 #include <string>
 #include <vector>
-#include <mutex>
+#include <queue>
+#include <functional>
+#include <algorithm>
 
-int readTimeStamps(char* dir, std::vector<std::vector<uint64_t>>& timeStamps) {
-    timeStamps.resize(19);
-    char filename[200];
-    for (int i = 0; i < 19; i ++) {
-        sprintf(filename, "%s/mcam_config_700%d", dir, i + 1);
-        FILE* fp;
-        fp = fopen(filename, "rb");
-        FRAME_METADATA frameInfo;
-        int result;
-        int ind = 0;
-        for(;;) {
-            result = fread(&frameInfo, 1, sizeof(frameInfo), fp);
-            if (result != sizeof(frameInfo))
-                break;
-            //printf("%d\t%lu\t%lu\n", ind, frameInfo.m_type, frameInfo.m_timestamp);
-            timeStamps[i].push_back(frameInfo.m_timestamp);
-            ind ++;
-        }
-        fclose(fp);
-    }
-    return 0;
-}
+struct TimeStampEvent {
+    uint64_t timeStamp;
+    int stream;
+    int ind;
 
-inline int timeStampDist(uint64_t t1, uint64_t t2) {
-    return t1 > t2 ? t1 - t2 : t2 - t1;
-}
+    bool operator>(const TimeStampEvent& other) const {
+        return timeStamp > other.timeStamp || (timeStamp == other.timeStamp && stream > other.stream);
+    }
+};
 
-int extractSyncFrames(std::vector<std::vector<uint64_t>> timeStamps, 
+/**
+ * @brief group the frames of all streams that lie within eps of each other
+ * @param selectedFrameInds frame index of every stream for every group
+ */
+int extractSyncFrames(const TimeStampTable& timeStamps, uint64_t eps,
     std::vector<std::vector<int>>& selectedFrameInds) {
-    // go through all the first frame to find the one having largest time stamp
-    uint64_t largestTimeStamp = 0;
-    uint64_t smallestTimeStamp = timeStamps[0][0];
-    for (int i = 0; i < 19; i ++) {
-        if (timeStamps[i][0] > largestTimeStamp) {
-            largestTimeStamp = timeStamps[i][0];
-        }
-        if (timeStamps[i][0] < smallestTimeStamp) {
-            smallestTimeStamp = timeStamps[i][0];
+    int numStreams = timeStamps.cameras();
+    selectedFrameInds.assign(numStreams, std::vector<int>());
+    std::priority_queue<TimeStampEvent, std::vector<TimeStampEvent>, std::greater<TimeStampEvent>> heap;
+    std::vector<uint32_t> streams(numStreams);
+    for (int i = 0; i < numStreams; i ++) {
+        streams[i] = (uint32_t)i;
+        if (timeStamps.size(i) > 0) {
+            TimeStampEvent event = { timeStamps.stream(i)[0], i, 0 };
+            heap.push(event);
         }
     }
-    printf("Timestamp of the first frame is %llu !\n", largestTimeStamp);
-    // find inds for each h264 stream
-    selectedFrameInds.resize(19);
-    uint64_t eps = 100000 / 6; 
-    for (int i = 0; i < 19; i ++) {
-        for (int ind = 0; ind < timeStamps[i].size(); ind ++) {
-            uint64_t dist = timeStampDist(largestTimeStamp, timeStamps[i][ind]);
-            if (dist < eps) {
-                if (ind < timeStamps[i].size() - 1) {
-                    uint64_t dist2 = timeStampDist(largestTimeStamp, timeStamps[i][ind + 1]);
-                    if (dist < dist2) {
-                        selectedFrameInds[i].push_back(ind);
-                        printf("Stream %d select %dth frame\n", i, ind);
-                    }
-                    else {
-                        selectedFrameInds[i].push_back(ind + 1);
-                        printf("Stream %d select %dth frame\n", i, ind + 1);
-                    }
-                }
-                else selectedFrameInds[i].push_back(ind);
-                break;
-            }
+
+    // fed in time order the queues of the synchronizer only hold the frames of one window
+    FrameSynchronizer sync(streams, eps, [&](const std::vector<SyncFrame>& group) {
+        for (int i = 0; i < numStreams; i ++)
+            selectedFrameInds[i].push_back((int)group[i].frame);
+    });
+    while (!heap.empty()) {
+        TimeStampEvent event = heap.top();
+        heap.pop();
+        if (event.ind + 1 < (int)timeStamps.size(event.stream)) {
+            TimeStampEvent next = { timeStamps.stream(event.stream)[event.ind + 1], event.stream, event.ind + 1 };
+            heap.push(next);
         }
+        sync.onFrame((uint32_t)event.stream, event.timeStamp, (uint64_t)event.ind);
     }
+    return 0;
+}
 
-    // init first frame
-    std::vector<int> curInds(19);
-    uint64_t startTime = smallestTimeStamp;
-    int curTime = 0;
-    int meanTime = 0;
-    for (int i = 0; i < 19; i ++) {
-        meanTime += (int)(timeStamps[i][selectedFrameInds[i][0]] - startTime);
-        curInds[i] = selectedFrameInds[i][0] + 1;
+/**
+ * @brief group every frame of the master stream with the nearest frame of
+ *        every other stream, if all of them lie within eps, for streams of
+ *        different frame rates
+ */
+int alignToMaster(const TimeStampTable& timeStamps, int master, uint64_t eps,
+    std::vector<std::vector<int>>& selectedFrameInds) {
+    int numStreams = timeStamps.cameras();
+    selectedFrameInds.assign(numStreams, std::vector<int>());
+    NearestFrames search(timeStamps);
+    std::vector<int> last(numStreams, -1);
+    std::vector<int> candidate(numStreams, -1);
+    std::vector<uint64_t> distance(numStreams, 0);
+    const uint64_t* masterStream = timeStamps.stream(master);
+    for (size_t m = 0; m < timeStamps.size(master); m ++) {
+        search.find(masterStream[m], &candidate[0], &distance[0]);
+        candidate[master] = (int)m;
+        distance[master] = 0;
+        // a frame of a slower stream belongs to one master frame only
+        bool complete = true;
+        for (int i = 0; i < numStreams; i ++)
+            complete &= distance[i] <= eps && candidate[i] > last[i];
+        if (!complete)
+            continue;
+        for (int i = 0; i < numStreams; i ++) {
+            selectedFrameInds[i].push_back(candidate[i]);
+            last[i] = candidate[i];
+        }
     }
-    meanTime /= 19;
-    curTime = meanTime;
-
-    printf("Current time is %d\n", curTime);
-    
-    bool lastframe = false;
+    return 0;
+}
 
-    // output information
-    for (int i = 0; i < 19; i ++) {   
-        printf("Stream %d has %lu frames, starts from index %d, has valid frames %d, current shift %d\n",
-            i, timeStamps[i].size(), selectedFrameInds[i][0], (int)timeStamps[i].size() - selectedFrameInds[i][0],
-                (int)(timeStamps[i][selectedFrameInds[i][0]] - startTime) - curTime);
+/**
+ * @brief the most groups of frames within eps of a master frame, and for these
+ *        groups the frames with the least total distance to their master frames
+ *
+ * The frames of a camera within eps of the master frames form ranges that
+ * only move forward. Taking a master frame whenever every camera still has a
+ * frame in its range, and always the earliest one, leaves the most frames
+ * for the later master frames, so no assignment has more groups. For these
+ * groups each camera then runs a dynamic program over its candidate frames,
+ * best[g][f] = |t(f) - t(g)| + min over f' < f of best[g - 1][f'], which is
+ * linear in the candidates since the ranges move forward as well.
+ */
+int alignOptimally(const TimeStampTable& timeStamps, int master, uint64_t eps, int threads,
+    std::vector<std::vector<int>>& selectedFrameInds) {
+    int numStreams = timeStamps.cameras();
+    selectedFrameInds.assign(numStreams, std::vector<int>());
+    const uint64_t* masterStream = timeStamps.stream(master);
+    std::vector<uint64_t> groupTimes;
+    // candidate range [low, high] of every camera for every group
+    std::vector<std::vector<int>> low(numStreams), high(numStreams);
+    std::vector<size_t> begin(numStreams, 0), end(numStreams, 0);
+    std::vector<int> last(numStreams, -1);
+    for (size_t m = 0; m < timeStamps.size(master); m ++) {
+        uint64_t t = masterStream[m];
+        bool complete = true;
+        for (int i = 0; i < numStreams; i ++) {
+            if (i == master)
+                continue;
+            const uint64_t* stream = timeStamps.stream(i);
+            size_t frames = timeStamps.size(i);
+            while (begin[i] < frames && stream[begin[i]] + eps < t)
+                begin[i]++;
+            while (end[i] < frames && stream[end[i]] <= t + eps)
+                end[i]++;
+            complete &= std::max<int>(last[i] + 1, (int)begin[i]) < (int)end[i];
+        }
+        if (!complete)
+            continue;
+        for (int i = 0; i < numStreams; i ++) {
+            int first = i == master ? (int)m : std::max<int>(last[i] + 1, (int)begin[i]);
+            low[i].push_back(first);
+            high[i].push_back(i == master ? (int)m : (int)end[i] - 1);
+            last[i] = first;
+        }
+        groupTimes.push_back(t);
     }
 
-    curTime += 100000 / 3;
-
-    int frameInd = 1; 
-    for (;;) {
-        // find index with the best time stamp
-        bool passsync = true;
-        for (int i = 0; i < 19; i ++) {
-            int dist;
-            uint64_t ts1 = timeStamps[i][curInds[i]] - startTime;
-            int dist1 = timeStampDist(ts1, curTime);
-            if (curInds[i] < timeStamps[i].size()) {
-                uint64_t ts2 = timeStamps[i][curInds[i] + 1] - startTime;
-                int dist2 = timeStampDist(ts2, curTime);
-                if (dist2 < dist1) {
-                    curInds[i]++;
-                    dist = dist2;
+    size_t groups = groupTimes.size();
+    parallelFor(numStreams, threads, [&](size_t i) {
+        std::vector<int>& selected = selectedFrameInds[i];
+        selected.resize(groups);
+        if (groups == 0)
+            return;
+        const uint64_t* stream = timeStamps.stream((int)i);
+        // candidates of group g are frames low[g]..high[g] at start[g] in cost and from
+        std::vector<size_t> start(groups + 1, 0);
+        for (size_t g = 0; g < groups; g ++)
+            start[g + 1] = start[g] + high[i][g] - low[i][g] + 1;
+        std::vector<double> cost(start[groups]);
+        std::vector<size_t> from(start[groups]);
+        for (size_t g = 0; g < groups; g ++) {
+            // cheapest candidate of the previous group before frame f, both move forward
+            size_t p = g > 0 ? start[g - 1] : 0, best = 0;
+            double bestCost = g > 0 ? HUGE_VAL : 0;
+            for (int f = low[i][g]; f <= high[i][g]; f ++) {
+                for (; g > 0 && p < start[g] && low[i][g - 1] + (int)(p - start[g - 1]) < f; p ++) {
+                    if (cost[p] < bestCost) {
+                        bestCost = cost[p];
+                        best = p;
+                    }
                 }
-                else dist = dist1;
-            }
-            if (dist > eps) {
-                passsync = false;
-                break;
+                size_t k = start[g] + f - low[i][g];
+                cost[k] = fabs((double)stream[f] - (double)groupTimes[g]) + bestCost;
+                from[k] = best;
             }
         }
-        // add new frame
-        if (passsync == true) {
-            printf("\nSelect new frame %d:\n", frameInd);
-            frameInd ++;
-            for (int i = 0; i < 19; i ++) {
-                selectedFrameInds[i].push_back(curInds[i]);
-                printf("Stream %d select %dth frames, time shift%d\n", i, curInds[i],
-                    (int)(timeStamps[i][curInds[i]] - startTime) - curTime);
-                curInds[i]++;
-            }
+        size_t k = start[groups - 1];
+        for (size_t c = start[groups - 1]; c < start[groups]; c ++)
+            if (cost[c] < cost[k])
+                k = c;
+        for (size_t g = groups; g-- > 0; ) {
+            selected[g] = low[i][g] + (int)(k - start[g]);
+            k = from[k];
         }
-        else {
+    });
+    return 0;
+}
 
-            for (int i = 0; i < 19; i ++) {
-                uint64_t ts = timeStamps[i][curInds[i]] - startTime;
-                if (ts > curTime && timeStampDist(ts, curTime) > eps) {
-                    // do nothing
-                }
-                else {
-                    curInds[i]++;
-                }
-            }   
+/**
+ * @brief save the groups as a sync index with the byte offsets of the frames
+ *        from the frame index of every camera, and as text if textfile is set
+ */
+int saveSyncFiles(const char* dir, const char* syncfile, const char* textfile, int threads,
+    const TimeStampTable& timeStamps, const std::vector<std::vector<int>>& selectedFrameInds) {
+    int numStreams = timeStamps.cameras();
+    size_t groups = selectedFrameInds[0].size();
+    std::vector<SyncIndexEntry> entries(groups * numStreams);
+    parallelFor(numStreams, threads, [&](size_t j) {
+        FrameIndex index;
+        if (index.open(dir, timeStamps.ids[j]) != 0)
+            printf("No byte offsets for camera %u\n", timeStamps.ids[j]);
+        for (size_t i = 0; i < groups; i ++) {
+            size_t frame = (size_t)selectedFrameInds[j][i];
+            SyncIndexEntry& entry = entries[i * numStreams + j];
+            entry.frame = (uint32_t)frame;
+            entry.timestamp = timeStamps.stream((int)j)[frame];
+            entry.offset = frame < index.size() ? index[frame].offset : SYNC_NO_OFFSET;
+            entry.size = frame < index.size() ? index[frame].size : 0;
         }
+    });
+    if (SyncIndex::save(syncfile, timeStamps.ids, entries) != 0)
+        return -1;
+    if (textfile == NULL)
+        return 0;
+    SyncIndex sync;
+    if (sync.open(syncfile) != 0)
+        return -1;
+    return sync.exportText(textfile);
+}
 
-        // check if last frame
-        for (int i = 0; i < 19; i ++) {
-            if (curInds[i] == timeStamps[i].size())
-                lastframe = true;
+void printClocks(const TimeStampTable& timeStamps, const TimeStampTable& corrected, int reference,
+    const std::vector<ClockFit>& fits, const std::vector<std::vector<int>>& selectedFrameInds) {
+    int numStreams = timeStamps.cameras();
+    size_t groups = selectedFrameInds[0].size();
+    // distance of every frame of a group from the mean of the group on the reference clock
+    std::vector<double> sum2(numStreams, 0), largest(numStreams, 0);
+    for (size_t g = 0; g < groups; g ++) {
+        double mean = 0;
+        for (int i = 0; i < numStreams; i ++)
+            mean += corrected.stream(i)[selectedFrameInds[i][g]];
+        mean /= numStreams;
+        for (int i = 0; i < numStreams; i ++) {
+            double r = fabs(corrected.stream(i)[selectedFrameInds[i][g]] - mean);
+            sum2[i] += r * r;
+            largest[i] = std::max(largest[i], r);
         }
-        if (lastframe == true)
-            break;
-        
-        curTime += 100000 / 3;
     }
-    return 0;
-}
-
-int saveSyncFiles(char* syncfile, std::vector<std::vector<uint64_t>> timeStamps, 
-    std::vector<std::vector<int>> selectedFrameInds) {
-    FILE* fp = fopen(syncfile, "w");
-    for (int i = 0; i < selectedFrameInds[0].size(); i ++) {
-        fprintf(fp, "%d\t", i);
-        for (int j = 0; j < 19; j ++) {
-            fprintf(fp, "%d\t%llu\t", selectedFrameInds[j][i], timeStamps[j][i]);
+    printf("Clocks against stream %u:\n", timeStamps.ids[reference]);
+    for (int i = 0; i < numStreams; i ++) {
+        printf("Stream %u", timeStamps.ids[i]);
+        if (i != reference && !fits[i].segments.empty()) {
+            const ClockSegment& first = fits[i].segments.front();
+            const ClockSegment& last = fits[i].segments.back();
+            double span = (double)timeStamps.stream(i)[timeStamps.size(i) - 1] - (double)first.start;
+            double drift = last.offset + last.skew * ((double)timeStamps.stream(i)[timeStamps.size(i) - 1] - last.start)
+                - first.offset;
+            printf(" offset %.1f us, skew %.2f ppm, drift %.1f us, %lu windows, fit rms %.1f us max %.1f us",
+                first.offset, span > 0 ? drift / span * 1e6 : 0.0, drift, fits[i].segments.size(),
+                fits[i].rms, fits[i].maxResidual);
         }
-        fprintf(fp, "\n");
+        if (groups > 0)
+            printf(", group residual rms %.1f us max %.1f us", sqrt(sum2[i] / groups), largest[i]);
+        printf("\n");
     }
-    fclose(fp);
-    return 0;
+}
+
+void printHelp() {
+    printf("Find the synchronized frames of all cameras of a session\n");
+    printf("Usage: FindSyncFrames <session dir> <sync index> [-t tolerance] [-j threads] [-w window] [-r mcam id] [-x text file] [-o]\n");
+    printf("\t-t tolerance largest time stamp difference within a group in us (default: half the shortest frame period)\n");
+    printf("\t-j threads   cameras loaded and fitted in parallel (default: number of cores)\n");
+    printf("\t-w window    seconds of every clock drift fit, 0 matches the recorded time stamps (default 60)\n");
+    printf("\t-r mcam id   reference clock and master of mixed frame rates (default: first of the slowest cameras)\n");
+    printf("\t-x text file also export the groups as a tab separated table of frame numbers and timestamps\n");
+    printf("\t-o           most groups within tolerance of the master frames, with the least total skew\n");
 }
 
 int main(int argc, char* argv[]) {
+    if (argc < 3 || strcmp(argv[1], "-h") == 0) {
+        printHelp();
+        return argc < 3 ? -1 : 0;
+    }
     char* dir = argv[1];
-    std::vector<std::vector<uint64_t>> timeStamps;
+    uint64_t eps = 0;
+    uint64_t window = 60;
+    int threads = 0;
+    uint32_t referenceId = 0;
+    char* textfile = NULL;
+    bool optimal = false;
+    for (int i = 3; i < argc; i ++) {
+        if (i + 1 < argc && strcmp(argv[i], "-t") == 0)
+            eps = strtoull(argv[++i], NULL, 10);
+        else if (i + 1 < argc && strcmp(argv[i], "-j") == 0)
+            threads = atoi(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "-w") == 0)
+            window = strtoull(argv[++i], NULL, 10);
+        else if (i + 1 < argc && strcmp(argv[i], "-r") == 0)
+            referenceId = (uint32_t)strtoul(argv[++i], NULL, 10);
+        else if (i + 1 < argc && strcmp(argv[i], "-x") == 0)
+            textfile = argv[++i];
+        else if (strcmp(argv[i], "-o") == 0)
+            optimal = true;
+        else {
+            printHelp();
+            return -1;
+        }
+    }
+    std::vector<uint32_t> ids = listCameras(dir);
+    if (ids.empty()) {
+        printf("No recorded camera in %s!\n", dir);
+        return -1;
+    }
+    TimeStampTable timeStamps;
     std::vector<std::vector<int>> selectedFrameInds;
-    readTimeStamps(dir, timeStamps);
-    extractSyncFrames(timeStamps, selectedFrameInds);
-    saveSyncFiles(argv[2], timeStamps, selectedFrameInds);
-    return 0;
-}
\ No newline at end of file
+    if (loadTimeStamps(dir, ids, threads, timeStamps) != 0)
+        return -1;
+    int reference = slowestCamera(timeStamps);
+    bool mixed = mixedFrameRates(timeStamps);
+    if (referenceId != 0) {
+        reference = (int)(std::find(ids.begin(), ids.end(), referenceId) - ids.begin());
+        if (reference == (int)ids.size()) {
+            printf("No recorded camera %u in %s!\n", referenceId, dir);
+            return -1;
+        }
+    }
+    for (size_t i = 0; i < ids.size(); i ++)
+        printf("Stream %u runs at %.3f fps (%s)\n", ids[i], timeStamps.periods[i] > 0 ? 1e6 / timeStamps.periods[i] : 0.0,
+            timeStamps.framerates[i] > 0 ? "metadata" : "median interval");
+    if (eps == 0)
+        eps = defaultTolerance(timeStamps);
+    if (optimal)
+        printf("Most groups within %lu us of master stream %u\n", eps, ids[reference]);
+    else if (mixed)
+        printf("Mixed frame rates, aligning to master stream %u with tolerance %lu us\n", ids[reference], eps);
+    const TimeStampTable* matched = &timeStamps;
+    TimeStampTable corrected;
+    std::vector<ClockFit> fits;
+    if (window > 0) {
+        correctClocks(timeStamps, reference, window * 1000000, eps, threads, fits, corrected);
+        matched = &corrected;
+    }
+    if (optimal)
+        alignOptimally(*matched, reference, eps, threads, selectedFrameInds);
+    else if (mixed)
+        alignToMaster(*matched, reference, eps, selectedFrameInds);
+    else
+        extractSyncFrames(*matched, eps, selectedFrameInds);
+    if (window > 0)
+        printClocks(timeStamps, corrected, reference, fits, selectedFrameInds);
+
+    size_t groups = selectedFrameInds[0].size();
+    for (size_t i = 0; i < ids.size(); i ++) {
+        printf("Stream %u has %lu frames, %lu in groups", ids[i], timeStamps.size((int)i), groups);
+        if (groups > 0)
+            printf(", first %d, last %d", selectedFrameInds[i][0], selectedFrameInds[i][groups - 1]);
+        printf("\n");
+    }
+    printf("Found %lu synchronized groups of %lu cameras\n", groups, ids.size());
+    return saveSyncFiles(dir, argv[2], textfile, threads, timeStamps, selectedFrameInds);
+}
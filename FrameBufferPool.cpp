@@ -0,0 +1,150 @@
+#include "FrameBufferPool.h"
+#include "Topology.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <algorithm>
+
+#define PAGE_SIZE_4K ((size_t)4096)
+#define HUGE_PAGE_SIZE ((size_t)2 << 20)
+
+static size_t alignUp(size_t size, size_t align) {
+    return (size + align - 1) / align * align;
+}
+
+static size_t roundUpPow2(size_t size) {
+    size_t p = 1;
+    while (p < size)
+        p <<= 1;
+    return p;
+}
+
+FrameBufferPool::FrameBufferPool() : arena(NULL), arenaBytes(0), huge(false), numaNode(-1) {
+    memset(&counters, 0, sizeof(counters));
+}
+
+FrameBufferPool::~FrameBufferPool() {
+    if (arena)
+        munmap(arena, arenaBytes);
+}
+
+std::vector<BufferClass> FrameBufferPool::plan(int cameras, uint64_t bitrate, double fps,
+    size_t queueFrames) {
+    std::vector<BufferClass> plan;
+    if (cameras <= 0 || bitrate == 0 || fps <= 0)
+        return plan;
+    // P frames are close to the average frame size, I frames several times larger
+    double avg = bitrate / 8.0 / fps;
+    size_t pSize = roundUpPow2(std::max<size_t>((size_t)(avg * 2), 64 << 10));
+    size_t iSize = roundUpPow2(std::max<size_t>((size_t)(avg * 12), pSize * 4));
+    BufferClass c;
+    c.bufferSize = pSize;
+    c.count = cameras * (queueFrames + 2);
+    plan.push_back(c);
+    c.bufferSize = pSize * 2;
+    c.count = cameras * 4;
+    plan.push_back(c);
+    c.bufferSize = iSize;
+    c.count = cameras * 4;
+    plan.push_back(c);
+    return plan;
+}
+
+int FrameBufferPool::init(const std::vector<BufferClass>& plan) {
+    if (arena || plan.empty())
+        return -1;
+    std::vector<BufferClass> sorted = plan;
+    std::sort(sorted.begin(), sorted.end(),
+        [](const BufferClass& a, const BufferClass& b) { return a.bufferSize < b.bufferSize; });
+    size_t total = 0;
+    for (size_t i = 0; i < sorted.size(); i ++) {
+        sorted[i].bufferSize = alignUp(sorted[i].bufferSize, PAGE_SIZE_4K);
+        total += alignUp(sorted[i].bufferSize * sorted[i].count, HUGE_PAGE_SIZE);
+    }
+
+    void* mem = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    huge = mem != MAP_FAILED;
+    if (!huge) {
+        // no reserved huge pages, ask for transparent huge pages instead
+        mem = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED) {
+            printf("Map frame buffer pool of %lu bytes failed!\n", total);
+            return -1;
+        }
+        madvise(mem, total, MADV_HUGEPAGE);
+    }
+    // the policy only applies to pages faulted after the bind
+    bindMemory(mem, total, numaNode);
+    arena = (uint8_t*)mem;
+    arenaBytes = total;
+    // fault the whole arena in now instead of in the frame callback
+    for (size_t offset = 0; offset < total; offset += PAGE_SIZE_4K)
+        arena[offset] = 0;
+
+    uint8_t* next = arena;
+    for (size_t i = 0; i < sorted.size(); i ++) {
+        SizeClass c;
+        c.bufferSize = sorted[i].bufferSize;
+        c.begin = next;
+        c.end = next + c.bufferSize * sorted[i].count;
+        c.free.reserve(sorted[i].count);
+        // hand out the lowest addresses first
+        for (size_t k = sorted[i].count; k > 0; k --)
+            c.free.push_back(next + (k - 1) * c.bufferSize);
+        classes.push_back(c);
+        next += alignUp(c.bufferSize * sorted[i].count, HUGE_PAGE_SIZE);
+    }
+    counters.arenaBytes = arenaBytes;
+    counters.hugePages = huge;
+    return 0;
+}
+
+uint8_t* FrameBufferPool::allocate(size_t size) {
+    if (arena) {
+        std::lock_guard<std::mutex> guard(mutex);
+        bool fits = false;
+        for (size_t i = 0; i < classes.size(); i ++) {
+            if (classes[i].bufferSize < size)
+                continue;
+            if (classes[i].free.empty()) {
+                fits = true;
+                continue;
+            }
+            uint8_t* ptr = classes[i].free.back();
+            classes[i].free.pop_back();
+            counters.allocations++;
+            if (fits)
+                counters.spills++;
+            counters.inUse++;
+            counters.peakInUse = std::max(counters.peakInUse, counters.inUse);
+            return ptr;
+        }
+        counters.misses++;
+    }
+    return new uint8_t[size];
+}
+
+void FrameBufferPool::release(uint8_t* ptr) {
+    if (arena && ptr >= arena && ptr < arena + arenaBytes) {
+        std::lock_guard<std::mutex> guard(mutex);
+        for (size_t i = 0; i < classes.size(); i ++) {
+            if (ptr >= classes[i].begin && ptr < classes[i].end) {
+                classes[i].free.push_back(ptr);
+                counters.inUse--;
+                return;
+            }
+        }
+        return;
+    }
+    delete[] ptr;
+}
+
+int FrameBufferPool::arenaNode() const {
+    return arena ? nodeOfAddress(arena) : -1;
+}
+
+PoolStats FrameBufferPool::stats() {
+    std::lock_guard<std::mutex> guard(mutex);
+    return counters;
+}
@@ -0,0 +1,85 @@
+/**
+ * @file FrameBufferPool.h
+ * @brief size-classed pool of frame buffers carved out of one pre-faulted
+ *        arena backed by 2 MB huge pages
+ *
+ * The recorder copies every frame out of the MantisAPI callback; taking the
+ * buffer from the pool instead of new/malloc avoids heap fragmentation over
+ * long recordings and keeps the hot buffers on few TLB entries. The arena is
+ * mapped with MAP_HUGETLB when huge pages are reserved, otherwise with
+ * transparent huge pages. Frames that do not fit any free buffer fall back
+ * to the heap and are counted as misses. The arena can be bound to the NUMA
+ * node of the thread that writes the frames out.
+ */
+#ifndef __FRAME_BUFFER_POOL_H__
+#define __FRAME_BUFFER_POOL_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <mutex>
+
+/**
+ * @brief buffers of one size
+ */
+struct BufferClass {
+    size_t bufferSize;
+    size_t count;
+};
+
+struct PoolStats {
+    uint64_t allocations;       //!< buffers handed out from the pool
+    uint64_t spills;            //!< of those, served from a larger class than needed
+    uint64_t misses;            //!< allocations that fell back to the heap
+    size_t inUse;               //!< pool buffers currently handed out
+    size_t peakInUse;           //!< highest number of pool buffers handed out at once
+    size_t arenaBytes;
+    bool hugePages;             //!< arena is backed by MAP_HUGETLB pages
+};
+
+class FrameBufferPool {
+public:
+    FrameBufferPool();
+    ~FrameBufferPool();
+
+    /**
+     * @brief buffer classes for the frames queued by a group of cameras
+     * @param bitrate expected bitrate per camera in bit/s
+     * @param fps expected frame rate
+     * @param queueFrames queue capacity per camera
+     */
+    static std::vector<BufferClass> plan(int cameras, uint64_t bitrate, double fps, size_t queueFrames);
+
+    /** @brief place the arena on a NUMA node, must be called before init, -1 for the default policy */
+    void setNumaNode(int node) { numaNode = node; }
+    /** @brief node actually holding the arena, -1 if unknown */
+    int arenaNode() const;
+
+    /** @brief map and pre-fault the arena, must be called before allocate */
+    int init(const std::vector<BufferClass>& classes);
+
+    uint8_t* allocate(size_t size);
+    void release(uint8_t* ptr);
+    PoolStats stats();
+    /** @brief base address and size of the arena */
+    void* arenaBase() const { return arena; }
+    size_t arenaSize() const { return arenaBytes; }
+
+private:
+    struct SizeClass {
+        size_t bufferSize;
+        uint8_t* begin;
+        uint8_t* end;
+        std::vector<uint8_t*> free;
+    };
+
+    std::vector<SizeClass> classes;
+    std::mutex mutex;
+    uint8_t* arena;
+    size_t arenaBytes;
+    bool huge;
+    int numaNode;
+    PoolStats counters;
+};
+
+#endif // __FRAME_BUFFER_POOL_H__
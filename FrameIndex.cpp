@@ -0,0 +1,245 @@
+#include "FrameIndex.h"
+#include "SessionFiles.h"
+#include "NalParser.h"
+#include "mantis/MantisAPI.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <algorithm>
+
+// the NAL headers of a frame are almost always in its first bytes
+#define HEADER_BYTES 4096
+
+void initFrameIndexHeader(FrameIndexHeader& header, int codec) {
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, FRAME_INDEX_MAGIC, sizeof(header.magic));
+    header.version = FRAME_INDEX_VERSION;
+    header.entrySize = sizeof(FrameIndexEntry);
+    header.codec = codec;
+}
+
+int classifyFrame(const uint8_t* data, size_t size, int& codec, FrameNals& nals) {
+    size_t n = std::min<size_t>(size, HEADER_BYTES);
+    for (;;) {
+        if (codec == CODEC_UNKNOWN)
+            codec = detectCodec(data, n);
+        parseFrame(data, n, codec, nals);
+        if (nals.frameType != FRAME_UNKNOWN || n == size)
+            return nals.frameType;
+        n = size;
+    }
+}
+
+FrameIndex::FrameIndex() : entries(NULL), count(0), map(NULL), mapSize(0), fd(-1), streamCodec(CODEC_UNKNOWN) {}
+
+FrameIndex::~FrameIndex() {
+    close();
+}
+
+int FrameIndex::open(const std::string& dir, uint32_t mcamId, bool save) {
+    close();
+    std::string h264file = streamFileName(dir, mcamId);
+    std::string metafile = metaFileName(dir, mcamId);
+    std::string indexfile = indexFileName(dir, mcamId);
+    fd = ::open(h264file.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || stat(metafile.c_str(), &st) != 0) {
+        printf("Open stream files of camera %u in %s failed!\n", mcamId, dir.c_str());
+        close();
+        return -1;
+    }
+    uint64_t metaFrames = st.st_size / sizeof(FRAME_METADATA);
+    uint64_t streamSize = fstat(fd, &st) == 0 ? st.st_size : 0;
+
+    int ret = 0;
+    if (mapFile(indexfile, metafile, metaFrames) != 0)
+        ret = build(metafile, 0, streamSize);
+    else if (count < metaFrames) {
+        // the recorder did not finish the index or is still writing it, index the rest in memory
+        built.assign(entries, entries + count);
+        munmap(map, mapSize);
+        map = NULL;
+        ret = build(metafile, count, streamSize);
+        save = false;
+    }
+    else save = false;
+    if (ret != 0) {
+        printf("Read metadata file %s failed!\n", metafile.c_str());
+        close();
+        return -1;
+    }
+    // frames the stream does not hold completely
+    while (count > 0 && entries[count - 1].offset + entries[count - 1].size > streamSize)
+        count--;
+    if (streamCodec == CODEC_UNKNOWN && count > 0) {
+        std::vector<uint8_t> buffer(std::min<size_t>(entries[0].size, HEADER_BYTES));
+        if (!buffer.empty() && pread(fd, &buffer[0], buffer.size(), 0) == (ssize_t)buffer.size())
+            streamCodec = detectCodec(&buffer[0], buffer.size());
+    }
+    if (save)
+        this->save(indexfile, 0, count);
+    return 0;
+}
+
+void FrameIndex::close() {
+    if (map)
+        munmap(map, mapSize);
+    map = NULL;
+    mapSize = 0;
+    if (fd >= 0)
+        ::close(fd);
+    fd = -1;
+    built.clear();
+    entries = NULL;
+    count = 0;
+    streamCodec = CODEC_UNKNOWN;
+}
+
+int FrameIndex::mapFile(const std::string& file, const std::string& metafile, uint64_t metaFrames) {
+    int fdidx = ::open(file.c_str(), O_RDONLY);
+    if (fdidx < 0)
+        return -1;
+    struct stat st;
+    FrameIndexHeader header;
+    if (fstat(fdidx, &st) != 0 || pread(fdidx, &header, sizeof(header), 0) != sizeof(header) ||
+        memcmp(header.magic, FRAME_INDEX_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != FRAME_INDEX_VERSION || header.entrySize != sizeof(FrameIndexEntry)) {
+        ::close(fdidx);
+        return -1;
+    }
+    // a partly written last entry is ignored
+    uint64_t frames = (st.st_size - sizeof(header)) / sizeof(FrameIndexEntry);
+    if (frames > metaFrames || frames == 0) {
+        ::close(fdidx);
+        return -1;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fdidx, 0);
+    ::close(fdidx);
+    if (map == MAP_FAILED) {
+        map = NULL;
+        return -1;
+    }
+    mapSize = st.st_size;
+    entries = (const FrameIndexEntry*)((const char*)map + sizeof(header));
+    count = frames;
+    streamCodec = header.codec;
+
+    // the last entry must still describe its frame of the sidecar, e.g. a cut session does not match
+    FRAME_METADATA frameInfo;
+    FILE* fpmeta = fopen(metafile.c_str(), "rb");
+    bool match = fpmeta && fseek(fpmeta, (long)((frames - 1) * sizeof(frameInfo)), SEEK_SET) == 0 &&
+        fread(&frameInfo, 1, sizeof(frameInfo), fpmeta) == sizeof(frameInfo) &&
+        frameInfo.m_size == entries[frames - 1].size && frameInfo.m_timestamp == entries[frames - 1].timestamp;
+    if (fpmeta)
+        fclose(fpmeta);
+    if (!match) {
+        munmap(map, mapSize);
+        map = NULL;
+        entries = NULL;
+        count = 0;
+        streamCodec = CODEC_UNKNOWN;
+        return -1;
+    }
+    return 0;
+}
+
+int FrameIndex::build(const std::string& metafile, size_t first, uint64_t streamSize) {
+    FILE* fpmeta = fopen(metafile.c_str(), "rb");
+    if (fpmeta == NULL)
+        return -1;
+    uint64_t offset = first > 0 ? built[first - 1].offset + built[first - 1].size : 0;
+    if (fseek(fpmeta, (long)(first * sizeof(FRAME_METADATA)), SEEK_SET) != 0) {
+        fclose(fpmeta);
+        return -1;
+    }
+    std::vector<uint8_t> buffer(HEADER_BYTES);
+    FrameNals nals;
+    FRAME_METADATA frameInfo;
+    while (fread(&frameInfo, 1, sizeof(frameInfo), fpmeta) == sizeof(frameInfo)) {
+        if (offset + frameInfo.m_size > streamSize)
+            break;
+        FrameIndexEntry entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.offset = offset;
+        entry.timestamp = frameInfo.m_timestamp;
+        entry.size = (uint32_t)frameInfo.m_size;
+        size_t n = std::min<size_t>(entry.size, HEADER_BYTES);
+        if (n > 0 && pread(fd, &buffer[0], n, offset) == (ssize_t)n) {
+            int type = classifyFrame(&buffer[0], n, streamCodec, nals);
+            if (type == FRAME_UNKNOWN && n < entry.size) {
+                buffer.resize(std::max<size_t>(buffer.size(), entry.size));
+                if (pread(fd, &buffer[0], entry.size, offset) == (ssize_t)entry.size)
+                    type = classifyFrame(&buffer[0], entry.size, streamCodec, nals);
+            }
+            entry.type = (uint8_t)type;
+            entry.keyframe = type == FRAME_IDR ? 1 : 0;
+        }
+        built.push_back(entry);
+        offset += frameInfo.m_size;
+    }
+    fclose(fpmeta);
+    entries = built.empty() ? NULL : &built[0];
+    count = built.size();
+    return 0;
+}
+
+int FrameIndex::save(const std::string& file, size_t first, size_t frames) const {
+    if (first + frames > count)
+        return -1;
+    std::string tmpfile = file + ".tmp";
+    FILE* fp = fopen(tmpfile.c_str(), "wb");
+    if (fp == NULL)
+        return -1;
+    FrameIndexHeader header;
+    initFrameIndexHeader(header, streamCodec);
+    fwrite(&header, 1, sizeof(header), fp);
+    uint64_t base = frames > 0 ? entries[first].offset : 0;
+    for (size_t i = first; i < first + frames; i ++) {
+        FrameIndexEntry entry = entries[i];
+        entry.offset -= base;
+        fwrite(&entry, 1, sizeof(entry), fp);
+    }
+    int ret = ferror(fp) ? -1 : 0;
+    if (fclose(fp) != 0 || ret != 0 || rename(tmpfile.c_str(), file.c_str()) != 0) {
+        unlink(tmpfile.c_str());
+        return -1;
+    }
+    return 0;
+}
+
+static bool timestampLess(const FrameIndexEntry& entry, uint64_t timestamp) {
+    return entry.timestamp < timestamp;
+}
+
+static bool timestampGreater(uint64_t timestamp, const FrameIndexEntry& entry) {
+    return timestamp < entry.timestamp;
+}
+
+size_t FrameIndex::lowerBound(uint64_t timestamp) const {
+    return std::lower_bound(entries, entries + count, timestamp, timestampLess) - entries;
+}
+
+size_t FrameIndex::upperFrame(uint64_t timestamp) const {
+    size_t i = std::upper_bound(entries, entries + count, timestamp, timestampGreater) - entries;
+    return i == 0 ? count : i - 1;
+}
+
+size_t FrameIndex::keyframeAtOrBefore(size_t i) const {
+    if (i >= count)
+        return count;
+    for (size_t k = i + 1; k > 0; k --)
+        if (entries[k - 1].keyframe)
+            return k - 1;
+    return count;
+}
+
+size_t FrameIndex::keyframeAtOrAfter(size_t i) const {
+    for (; i < count; i ++)
+        if (entries[i].keyframe)
+            return i;
+    return count;
+}
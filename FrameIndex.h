@@ -0,0 +1,100 @@
+/**
+ * @file FrameIndex.h
+ * @brief byte offset, timestamp and frame type of every frame of a recorded camera
+ *
+ * The index of a camera is kept in mcam_idx_<id>: a FrameIndexHeader followed
+ * by one FrameIndexEntry per frame, parallel to the records of the metadata
+ * sidecar. The recorder writes it along with the stream, for older sessions
+ * it is built from the sidecar and the frame headers on first use and saved.
+ * Opening an index maps the file, so looking up a frame by number is O(1)
+ * and by timestamp a binary search, timestamps are expected to grow with
+ * the frame number.
+ */
+#ifndef __FRAME_INDEX_H__
+#define __FRAME_INDEX_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+struct FrameNals;
+
+#define FRAME_INDEX_MAGIC "MCAMIDX"
+#define FRAME_INDEX_VERSION 1
+
+struct FrameIndexHeader {
+    char magic[8];          //!< FRAME_INDEX_MAGIC
+    uint32_t version;       //!< FRAME_INDEX_VERSION
+    uint32_t entrySize;     //!< sizeof(FrameIndexEntry)
+    uint32_t codec;         //!< Codec, CODEC_UNKNOWN if the writer did not finish
+    uint32_t reserved;
+};
+
+struct FrameIndexEntry {
+    uint64_t offset;        //!< byte offset of the frame in mcam_<id>
+    uint64_t timestamp;     //!< m_timestamp of the frame
+    uint32_t size;          //!< m_size of the frame
+    uint8_t type;           //!< FrameType
+    uint8_t keyframe;       //!< 1 for IDR (h264) / IRAP (h265) frames
+    uint16_t reserved;
+};
+
+void initFrameIndexHeader(FrameIndexHeader& header, int codec);
+
+/**
+ * @brief FrameType of a frame from its NAL units, the first bytes are parsed
+ *        first and the rest only if they hold no slice
+ * @param codec codec of the stream, detected from the frame if CODEC_UNKNOWN
+ */
+int classifyFrame(const uint8_t* data, size_t size, int& codec, FrameNals& nals);
+
+class FrameIndex {
+public:
+    FrameIndex();
+    ~FrameIndex();
+
+    /**
+     * @brief open the index of a camera, build and save it if there is none or
+     *        it does not match the sidecar; frames beyond the end of a truncated
+     *        stream are left out
+     * @param save write a built index to mcam_idx_<id>
+     */
+    int open(const std::string& dir, uint32_t mcamId, bool save = true);
+    void close();
+
+    size_t size() const { return count; }
+    const FrameIndexEntry& operator[](size_t i) const { return entries[i]; }
+    /** @brief descriptor of the opened stream file */
+    int streamFd() const { return fd; }
+    /** @brief codec of the stream */
+    int codec() const { return streamCodec; }
+    /** @brief true if the index was mapped from mcam_idx_<id> */
+    bool mapped() const { return map != NULL; }
+
+    /** @brief first frame with a timestamp >= timestamp, size() if there is none */
+    size_t lowerBound(uint64_t timestamp) const;
+    /** @brief last frame with a timestamp <= timestamp, size() if there is none */
+    size_t upperFrame(uint64_t timestamp) const;
+    /** @brief last key frame at or before frame i, size() if there is none */
+    size_t keyframeAtOrBefore(size_t i) const;
+    /** @brief first key frame at or after frame i, size() if there is none */
+    size_t keyframeAtOrAfter(size_t i) const;
+
+    /** @brief write frames [first, first + frames) as the index of a stream starting with frame first */
+    int save(const std::string& file, size_t first, size_t frames) const;
+
+private:
+    int mapFile(const std::string& file, const std::string& metafile, uint64_t metaFrames);
+    int build(const std::string& metafile, size_t first, uint64_t streamSize);
+
+    const FrameIndexEntry* entries;
+    size_t count;
+    std::vector<FrameIndexEntry> built;
+    void* map;
+    size_t mapSize;
+    int fd;
+    int streamCodec;
+};
+
+#endif // __FRAME_INDEX_H__
@@ -0,0 +1,382 @@
+#include "FrameRecorder.h"
+#include "SessionFiles.h"
+#include "CRC32C.h"
+#include "FrameIndex.h"
+
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+
+/*************************************************************
+* LatencyHistogram
+*************************************************************/
+LatencyHistogram::LatencyHistogram() : buckets(kBuckets, 0), total(0), maxValue(0) {}
+
+int LatencyHistogram::bucketOf(uint64_t us) {
+    if (us < (1u << kSubBits))
+        return (int)us;
+    int msb = 63 - __builtin_clzll(us);
+    int shift = msb - kSubBits;
+    int sub = (int)((us >> shift) & ((1 << kSubBits) - 1));
+    return ((shift + 1) << kSubBits) + sub;
+}
+
+uint64_t LatencyHistogram::bucketUpper(int bucket) {
+    if (bucket < (1 << kSubBits))
+        return bucket;
+    int shift = (bucket >> kSubBits) - 1;
+    uint64_t sub = bucket & ((1 << kSubBits) - 1);
+    uint64_t lower = ((1ull << kSubBits) + sub) << shift;
+    return lower + (1ull << shift) - 1;
+}
+
+void LatencyHistogram::add(uint64_t us) {
+    buckets[bucketOf(us)]++;
+    total++;
+    if (us > maxValue)
+        maxValue = us;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+    for (int i = 0; i < kBuckets; i ++)
+        buckets[i] += other.buckets[i];
+    total += other.total;
+    if (other.maxValue > maxValue)
+        maxValue = other.maxValue;
+}
+
+uint64_t LatencyHistogram::percentile(double p) const {
+    if (total == 0)
+        return 0;
+    uint64_t target = (uint64_t)(p * total);
+    if (target >= total)
+        target = total - 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < kBuckets; i ++) {
+        seen += buckets[i];
+        if (seen > target) {
+            uint64_t upper = bucketUpper(i);
+            return upper < maxValue ? upper : maxValue;
+        }
+    }
+    return maxValue;
+}
+
+void LatencyHistogram::clear() {
+    std::fill(buckets.begin(), buckets.end(), 0);
+    total = 0;
+    maxValue = 0;
+}
+
+/*************************************************************
+* FrameRecorder
+*************************************************************/
+FrameRecorder::FrameRecorder(const RecorderConfig& config) : config(config), sync(NULL), running(false) {
+    if (!this->config.placement.empty())
+        this->config.writerThreads = (int)this->config.placement.size();
+    if (this->config.writerThreads < 1)
+        this->config.writerThreads = 1;
+    for (int i = 0; i < this->config.writerThreads; i ++) {
+        Writer* writer = new Writer;
+        writer->pending = 0;
+        writers.push_back(writer);
+    }
+}
+
+FrameRecorder::~FrameRecorder() {
+    stop();
+    for (size_t i = 0; i < cameras.size(); i ++) {
+        delete cameras[i]->tap;
+        delete cameras[i];
+    }
+    for (size_t i = 0; i < writers.size(); i ++)
+        delete writers[i];
+}
+
+int FrameRecorder::addCamera(uint32_t mcamId) {
+    if (running || cameraMap.count(mcamId))
+        return -1;
+    std::string fileName = streamFileName(config.dir, mcamId);
+
+    Camera* cam = new Camera;
+    cam->mcamId = mcamId;
+    cam->writer = (int)(cameras.size() % writers.size());
+    for (size_t i = 0; i < config.placement.size(); i ++) {
+        const std::vector<uint32_t>& ids = config.placement[i].cameras;
+        if (std::find(ids.begin(), ids.end(), mcamId) != ids.end())
+            cam->writer = (int)i;
+    }
+    cam->fpStream = fopen(fileName.c_str(), "wb");
+    cam->fpMeta = fopen(metaFileName(config.dir, mcamId).c_str(), "wb");
+    cam->fpCrc = config.checksums ? fopen(checksumFileName(config.dir, mcamId).c_str(), "wb") : NULL;
+    cam->fpIndex = config.frameIndex ? fopen(indexFileName(config.dir, mcamId).c_str(), "wb") : NULL;
+    if (cam->fpStream == NULL || cam->fpMeta == NULL || (config.checksums && cam->fpCrc == NULL) ||
+        (config.frameIndex && cam->fpIndex == NULL)) {
+        printf("Open output file for camera %u failed!\n", mcamId);
+        if (cam->fpStream) fclose(cam->fpStream);
+        if (cam->fpMeta) fclose(cam->fpMeta);
+        if (cam->fpCrc) fclose(cam->fpCrc);
+        if (cam->fpIndex) fclose(cam->fpIndex);
+        delete cam;
+        return -1;
+    }
+    cam->codec = CODEC_UNKNOWN;
+    if (cam->fpIndex) {
+        // the codec is filled in when the recording stops
+        FrameIndexHeader header;
+        initFrameIndexHeader(header, CODEC_UNKNOWN);
+        fwrite(&header, 1, sizeof(header), cam->fpIndex);
+    }
+    if (config.ioBufferSize > 0) {
+        cam->streamBuf.resize(config.ioBufferSize);
+        cam->metaBuf.resize(sizeof(FRAME_METADATA) * 256);
+        setvbuf(cam->fpStream, &cam->streamBuf[0], _IOFBF, cam->streamBuf.size());
+        setvbuf(cam->fpMeta, &cam->metaBuf[0], _IOFBF, cam->metaBuf.size());
+    }
+    cam->tap = NULL;
+    if (!config.tapPrefix.empty()) {
+        cam->tap = new SharedFrameWriter;
+        if (cam->tap->create(config.tapPrefix, mcamId, config.tapSlots, config.tapBytes) != 0) {
+            delete cam->tap;
+            cam->tap = NULL;
+        }
+    }
+    cam->received = 0;
+    cam->receivedBytes = 0;
+    cam->receivedTimestamp = 0;
+    cam->lastTimestamp = 0;
+    cam->dropped = 0;
+    cam->written = 0;
+    cam->bytes = 0;
+
+    cameras.push_back(cam);
+    cameraMap[mcamId] = cam;
+    writers[cam->writer]->cameras.push_back(cam);
+    if (config.verbose)
+        printf("Camera %u saved to %s, writer thread %d\n", mcamId, fileName.c_str(), cam->writer);
+    return 0;
+}
+
+int FrameRecorder::start() {
+    if (running)
+        return -1;
+    // every writer gets a buffer pool sized for the queues of its cameras
+    for (size_t i = 0; i < writers.size() && config.expectedBitrate > 0; i ++) {
+        Writer* writer = writers[i];
+        if (writer->cameras.empty())
+            continue;
+        std::vector<BufferClass> plan = FrameBufferPool::plan((int)writer->cameras.size(),
+            config.expectedBitrate, config.expectedFps, config.queueFrames);
+        if (i < config.placement.size())
+            writer->pool.setNumaNode(config.placement[i].node);
+        if (writer->pool.init(plan) != 0)
+            continue;
+        if (config.verbose)
+            printf("Writer thread %lu frame buffer pool %.1f MB, %s\n", i, writer->pool.arenaSize() / 1e6,
+                writer->pool.stats().hugePages ? "huge pages" : "transparent huge pages");
+    }
+    running = true;
+    for (size_t i = 0; i < writers.size(); i ++) {
+        writers[i]->thread = std::thread(&FrameRecorder::writerLoop, this, writers[i]);
+        if (i < config.placement.size() && !config.placement[i].cpus.empty())
+            pinThread(writers[i]->thread.native_handle(), config.placement[i].cpus);
+    }
+    return 0;
+}
+
+int FrameRecorder::stop() {
+    if (!running)
+        return 0;
+    running = false;
+    for (size_t i = 0; i < writers.size(); i ++) {
+        {
+            std::lock_guard<std::mutex> guard(writers[i]->mutex);
+        }
+        writers[i]->cond.notify_all();
+        writers[i]->thread.join();
+    }
+    for (size_t i = 0; i < cameras.size(); i ++) {
+        fclose(cameras[i]->fpStream);
+        fclose(cameras[i]->fpMeta);
+        if (cameras[i]->fpCrc)
+            fclose(cameras[i]->fpCrc);
+        if (cameras[i]->fpIndex) {
+            FrameIndexHeader header;
+            initFrameIndexHeader(header, cameras[i]->codec);
+            fseek(cameras[i]->fpIndex, 0, SEEK_SET);
+            fwrite(&header, 1, sizeof(header), cameras[i]->fpIndex);
+            fclose(cameras[i]->fpIndex);
+        }
+        cameras[i]->fpStream = NULL;
+        cameras[i]->fpMeta = NULL;
+        cameras[i]->fpCrc = NULL;
+        cameras[i]->fpIndex = NULL;
+    }
+    return 0;
+}
+
+bool FrameRecorder::pushFrame(const FRAME& frame) {
+    if (frame.m_metadata.m_tile != config.recordTile)
+        return false;
+    std::unordered_map<uint32_t, Camera*>::const_iterator it = cameraMap.find(frame.m_metadata.m_camId);
+    if (it == cameraMap.end())
+        return false;
+    Camera* cam = it->second;
+    if (cam->tap)
+        cam->tap->publish(frame.m_metadata, frame.m_image);
+    cam->received++;
+    cam->receivedBytes += frame.m_metadata.m_size;
+    cam->receivedTimestamp = frame.m_metadata.m_timestamp;
+    if (sync)
+        sync->onFrame(cam->mcamId, frame.m_metadata.m_timestamp, frame.m_metadata.m_id);
+
+    Writer* writer = writers[cam->writer];
+    QueuedFrame item;
+    item.meta = frame.m_metadata;
+    item.data = writer->pool.allocate(frame.m_metadata.m_size);
+    memcpy(item.data, frame.m_image, frame.m_metadata.m_size);
+
+    {
+        std::lock_guard<std::mutex> guard(writer->mutex);
+        if (cam->queue.size() >= config.queueFrames) {
+            cam->dropped++;
+            writer->pool.release(item.data);
+            return false;
+        }
+        cam->queue.push_back(item);
+        writer->pending++;
+    }
+    writer->cond.notify_one();
+    return true;
+}
+
+void FrameRecorder::frameCallback(FRAME frame, void* data) {
+    static_cast<FrameRecorder*>(data)->pushFrame(frame);
+}
+
+uint64_t FrameRecorder::writeFrame(Camera* cam, QueuedFrame& frame, FrameBufferPool& pool) {
+    FrameChecksum checksum;
+    if (cam->fpCrc) {
+        checksum.data = crc32c(0, frame.data, frame.meta.m_size);
+        checksum.meta = crc32c(0, &frame.meta, sizeof(frame.meta));
+    }
+    FrameIndexEntry entry;
+    if (cam->fpIndex) {
+        memset(&entry, 0, sizeof(entry));
+        entry.offset = cam->bytes;
+        entry.timestamp = frame.meta.m_timestamp;
+        entry.size = (uint32_t)frame.meta.m_size;
+        entry.type = (uint8_t)classifyFrame(frame.data, frame.meta.m_size, cam->codec, cam->nals);
+        entry.keyframe = entry.type == FRAME_IDR ? 1 : 0;
+    }
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    fwrite(frame.data, 1, frame.meta.m_size, cam->fpStream);
+    fwrite(&frame.meta, 1, sizeof(frame.meta), cam->fpMeta);
+    if (cam->fpCrc)
+        fwrite(&checksum, 1, sizeof(checksum), cam->fpCrc);
+    if (cam->fpIndex)
+        fwrite(&entry, 1, sizeof(entry), cam->fpIndex);
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    pool.release(frame.data);
+    return std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count();
+}
+
+void FrameRecorder::writerLoop(Writer* writer) {
+    size_t next = 0;
+    std::unique_lock<std::mutex> lock(writer->mutex);
+    for (;;) {
+        while (writer->pending == 0 && running)
+            writer->cond.wait(lock);
+        if (writer->pending == 0 && !running)
+            break;
+        // round robin over the cameras of this writer, one frame each
+        Camera* cam = NULL;
+        for (size_t i = 0; i < writer->cameras.size(); i ++) {
+            Camera* c = writer->cameras[(next + i) % writer->cameras.size()];
+            if (!c->queue.empty()) {
+                cam = c;
+                next = (next + i + 1) % writer->cameras.size();
+                break;
+            }
+        }
+        QueuedFrame frame = cam->queue.front();
+        cam->queue.pop_front();
+        writer->pending--;
+        lock.unlock();
+
+        uint64_t us = writeFrame(cam, frame, writer->pool);
+
+        lock.lock();
+        writer->latency.add(us);
+        cam->written++;
+        cam->bytes += frame.meta.m_size;
+        cam->lastTimestamp = frame.meta.m_timestamp;
+    }
+}
+
+std::vector<CameraStats> FrameRecorder::cameraStats() {
+    std::vector<CameraStats> stats(cameras.size());
+    for (size_t i = 0; i < cameras.size(); i ++) {
+        Camera* cam = cameras[i];
+        std::lock_guard<std::mutex> guard(writers[cam->writer]->mutex);
+        stats[i].mcamId = cam->mcamId;
+        stats[i].received = cam->received;
+        stats[i].receivedBytes = cam->receivedBytes;
+        stats[i].lastTimestamp = cam->lastTimestamp;
+        stats[i].dropped = cam->dropped;
+        stats[i].written = cam->written;
+        stats[i].bytes = cam->bytes;
+        stats[i].queueDepth = cam->queue.size();
+    }
+    return stats;
+}
+
+uint64_t FrameRecorder::receivedTimestamp(uint32_t mcamId) const {
+    std::unordered_map<uint32_t, Camera*>::const_iterator it = cameraMap.find(mcamId);
+    return it == cameraMap.end() ? 0 : it->second->receivedTimestamp.load();
+}
+
+LatencyHistogram FrameRecorder::writeLatency() {
+    LatencyHistogram hist;
+    for (size_t i = 0; i < writers.size(); i ++) {
+        std::lock_guard<std::mutex> guard(writers[i]->mutex);
+        hist.merge(writers[i]->latency);
+    }
+    return hist;
+}
+
+PoolStats FrameRecorder::poolStats() {
+    PoolStats total;
+    memset(&total, 0, sizeof(total));
+    total.hugePages = true;
+    for (size_t i = 0; i < writers.size(); i ++) {
+        PoolStats s = writers[i]->pool.stats();
+        total.allocations += s.allocations;
+        total.spills += s.spills;
+        total.misses += s.misses;
+        total.inUse += s.inUse;
+        total.peakInUse += s.peakInUse;
+        total.arenaBytes += s.arenaBytes;
+        if (s.arenaBytes > 0)
+            total.hugePages = total.hugePages && s.hugePages;
+    }
+    if (total.arenaBytes == 0)
+        total.hugePages = false;
+    return total;
+}
+
+void FrameRecorder::printPlacement(FILE* fp) {
+    for (size_t i = 0; i < writers.size(); i ++) {
+        Writer* writer = writers[i];
+        std::vector<int> cpus;
+        if (writer->thread.joinable())
+            cpus = threadCpus(writer->thread.native_handle());
+        std::string ids;
+        for (size_t c = 0; c < writer->cameras.size(); c ++)
+            ids += (c ? "," : "") + std::to_string(writer->cameras[c]->mcamId);
+        int node = writer->pool.arenaNode();
+        fprintf(fp, "Writer thread %lu: cpus %s, buffer pool node %s, cameras %s\n", i,
+            cpus.empty() ? "-" : cpuListString(cpus).c_str(),
+            node < 0 ? "-" : std::to_string(node).c_str(), ids.c_str());
+    }
+}
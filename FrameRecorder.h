@@ -0,0 +1,184 @@
+/**
+ * @file FrameRecorder.h
+ * @brief asynchronous recorder that writes mcam frames into per camera
+ *        h264 stream files (mcam_<id>), metadata sidecars (mcam_config_<id>),
+ *        crc32c checksum sidecars (mcam_crc_<id>) and frame indexes (mcam_idx_<id>)
+ *
+ * The MantisAPI frame callback only copies the frame into a bounded per
+ * camera queue; writer threads drain the queues to disk. When a queue is
+ * full the frame is dropped and counted instead of stalling the receiver.
+ */
+#ifndef __FRAME_RECORDER_H__
+#define __FRAME_RECORDER_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include <unordered_map>
+#include "mantis/MantisAPI.h"
+#include "SharedFrameRing.h"
+#include "FrameBufferPool.h"
+#include "Topology.h"
+#include "NalParser.h"
+#include "FrameSynchronizer.h"
+
+/**
+ * @brief log-linear latency histogram in microseconds, 8 sub-buckets per octave
+ */
+class LatencyHistogram {
+public:
+    LatencyHistogram();
+    void add(uint64_t us);
+    void merge(const LatencyHistogram& other);
+    /** @brief value (us) below which the given fraction of samples fall */
+    uint64_t percentile(double p) const;
+    uint64_t count() const { return total; }
+    uint64_t max() const { return maxValue; }
+    void clear();
+
+private:
+    static const int kSubBits = 3;
+    static const int kBuckets = 64 << kSubBits;
+    static int bucketOf(uint64_t us);
+    static uint64_t bucketUpper(int bucket);
+    std::vector<uint64_t> buckets;
+    uint64_t total;
+    uint64_t maxValue;
+};
+
+/**
+ * @brief recorder configuration
+ */
+struct RecorderConfig {
+    std::string dir;            //!< output directory
+    int writerThreads;          //!< writer threads, cameras are assigned round robin
+    std::vector<WriterPlacement> placement; //!< cpus, NUMA node and cameras of every writer thread,
+                                //   overrides writerThreads when not empty
+    size_t queueFrames;         //!< per camera queue capacity before frames are dropped
+    size_t ioBufferSize;        //!< stdio buffer size of every output file
+    int recordTile;             //!< the scale (m_tile) to record, other scales are ignored
+                                //   (acosd "-s 2": 0 is 3864x2174, 1 is 1920x1080)
+    bool checksums;             //!< write the crc32c of every frame to mcam_crc_<id>
+    bool frameIndex;            //!< write the offset and frame type of every frame to mcam_idx_<id>
+    std::string tapPrefix;      //!< publish received frames to shared memory /<tapPrefix>_<id>, empty disables
+    uint32_t tapSlots;          //!< frames kept in each shared memory ring
+    uint64_t tapBytes;          //!< frame bytes kept in each shared memory ring
+    uint64_t expectedBitrate;   //!< bitrate per camera in bit/s used to size the frame buffer pools,
+                                //   0 allocates every frame from the heap
+    double expectedFps;         //!< frame rate used to size the frame buffer pools
+    bool verbose;               //!< print the output files of every camera
+
+    RecorderConfig() : writerThreads(1), queueFrames(64),
+        ioBufferSize(1 << 20), recordTile(0), checksums(true), frameIndex(true),
+        tapSlots(256), tapBytes(64 << 20), expectedBitrate(0), expectedFps(30),
+        verbose(true) {}
+};
+
+/**
+ * @brief per camera counters
+ */
+struct CameraStats {
+    uint32_t mcamId;
+    uint64_t received;          //!< frames of the recorded scale handed to the recorder
+    uint64_t receivedBytes;     //!< stream bytes handed to the recorder
+    uint64_t written;           //!< frames written to disk
+    uint64_t dropped;           //!< frames dropped because the queue was full
+    uint64_t bytes;             //!< stream bytes written
+    size_t queueDepth;          //!< frames currently waiting in the queue
+    uint64_t lastTimestamp;     //!< timestamp of the last frame written
+};
+
+class FrameRecorder {
+public:
+    explicit FrameRecorder(const RecorderConfig& config);
+    ~FrameRecorder();
+
+    /** @brief open the output files of a camera, must be called before start */
+    int addCamera(uint32_t mcamId);
+    /** @brief spawn writer threads */
+    int start();
+    /** @brief drain all queues, join writer threads and close the files */
+    int stop();
+
+    /**
+     * @brief publish a received frame to the shared memory tap and copy it into
+     *        the queue of its camera; frames of one camera must come from one thread
+     * @return false if the frame was dropped or not recorded
+     */
+    bool pushFrame(const FRAME& frame);
+    /**
+     * @brief hand the m_timestamp and m_id of every received frame to a synchronizer,
+     *        NULL disables; must be called before start
+     */
+    void setSynchronizer(FrameSynchronizer* sync) { this->sync = sync; }
+    /** @brief MICRO_CAMERA_FRAME_CALLBACK entry, data is the FrameRecorder */
+    static void frameCallback(FRAME frame, void* data);
+
+    std::vector<CameraStats> cameraStats();
+    /** @brief timestamp of the last frame received from a camera, 0 if none */
+    uint64_t receivedTimestamp(uint32_t mcamId) const;
+    /** @brief write latency of one frame (stream + sidecar) over all writers */
+    LatencyHistogram writeLatency();
+    /** @brief frame buffer pool counters summed over all writers */
+    PoolStats poolStats();
+    /** @brief print the cpus, buffer pool node and cameras of every writer thread */
+    void printPlacement(FILE* fp);
+    const RecorderConfig& getConfig() const { return config; }
+
+private:
+    struct QueuedFrame {
+        FRAME_METADATA meta;
+        uint8_t* data;
+    };
+
+    struct Camera {
+        uint32_t mcamId;
+        int writer;
+        FILE* fpStream;
+        FILE* fpMeta;
+        FILE* fpCrc;
+        FILE* fpIndex;
+        int codec;
+        FrameNals nals;
+        SharedFrameWriter* tap;
+        std::vector<char> streamBuf;
+        std::vector<char> metaBuf;
+        std::deque<QueuedFrame> queue;
+        std::atomic<uint64_t> received;
+        std::atomic<uint64_t> receivedBytes;
+        std::atomic<uint64_t> receivedTimestamp;
+        std::atomic<uint64_t> dropped;
+        uint64_t written;
+        uint64_t bytes;
+        uint64_t lastTimestamp;
+    };
+
+    struct Writer {
+        std::mutex mutex;
+        std::condition_variable cond;
+        std::vector<Camera*> cameras;
+        std::thread thread;
+        FrameBufferPool pool;
+        LatencyHistogram latency;
+        size_t pending;
+    };
+
+    void writerLoop(Writer* writer);
+    /** @return write time in microseconds */
+    uint64_t writeFrame(Camera* cam, QueuedFrame& frame, FrameBufferPool& pool);
+
+    RecorderConfig config;
+    std::vector<Camera*> cameras;
+    std::unordered_map<uint32_t, Camera*> cameraMap;
+    std::vector<Writer*> writers;
+    FrameSynchronizer* sync;
+    std::atomic<bool> running;
+};
+
+#endif // __FRAME_RECORDER_H__
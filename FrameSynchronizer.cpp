@@ -0,0 +1,68 @@
+#include "FrameSynchronizer.h"
+
+FrameSynchronizer::FrameSynchronizer(const std::vector<uint32_t>& ids, uint64_t tolerance,
+    const GroupCallback& callback, size_t depth)
+    : ids(ids), queues(ids.size()), group(ids.size()), tolerance(tolerance), depth(depth > 0 ? depth : 1),
+      callback(callback), groupCount(0), discardCount(0) {
+    for (size_t i = 0; i < ids.size(); i ++)
+        index[ids[i]] = i;
+}
+
+bool FrameSynchronizer::onFrame(uint32_t mcamId, uint64_t timeStamp, uint64_t frame) {
+    std::unordered_map<uint32_t, size_t>::const_iterator it = index.find(mcamId);
+    if (it == index.end())
+        return false;
+    std::lock_guard<std::mutex> guard(mutex);
+    std::deque<SyncFrame>& queue = queues[it->second];
+    if (!queue.empty() && timeStamp < queue.back().timeStamp)
+        return false;
+    SyncFrame item = { mcamId, timeStamp, frame };
+    queue.push_back(item);
+    if (queue.size() > depth) {
+        queue.pop_front();
+        discardCount++;
+    }
+    match();
+    return true;
+}
+
+void FrameSynchronizer::match() {
+    for (;;) {
+        size_t oldest = 0;
+        uint64_t first = UINT64_MAX, last = 0;
+        for (size_t i = 0; i < queues.size(); i ++) {
+            if (queues[i].empty())
+                return;
+            uint64_t t = queues[i].front().timeStamp;
+            if (t < first) {
+                first = t;
+                oldest = i;
+            }
+            if (t > last)
+                last = t;
+        }
+        // every later frame of the other cameras is even further away from the oldest one
+        if (last - first > tolerance) {
+            queues[oldest].pop_front();
+            discardCount++;
+            continue;
+        }
+        for (size_t i = 0; i < queues.size(); i ++) {
+            group[i] = queues[i].front();
+            queues[i].pop_front();
+        }
+        groupCount++;
+        if (callback)
+            callback(group);
+    }
+}
+
+uint64_t FrameSynchronizer::groups() const {
+    std::lock_guard<std::mutex> guard(mutex);
+    return groupCount;
+}
+
+uint64_t FrameSynchronizer::discarded() const {
+    std::lock_guard<std::mutex> guard(mutex);
+    return discardCount;
+}
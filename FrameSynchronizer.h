@@ -0,0 +1,69 @@
+/**
+ * @file FrameSynchronizer.h
+ * @brief incremental synchronizer that groups the frames of all cameras
+ *        as they arrive, for the recorder, live previews and FindSyncFrames
+ *
+ * Every camera has a short queue of frames that are not in a group yet.
+ * Whenever all queues hold a frame, the oldest frames of the queues form a
+ * group if they lie within the tolerance; otherwise the oldest of them can
+ * never be matched any more and is discarded. A group is emitted as soon as
+ * the last of its frames arrives, and the result does not depend on how the
+ * frames of different cameras interleave. A camera that stops delivering
+ * holds back at most depth frames of every other camera.
+ */
+#ifndef __FRAME_SYNCHRONIZER_H__
+#define __FRAME_SYNCHRONIZER_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <functional>
+#include <unordered_map>
+
+struct SyncFrame {
+    uint32_t mcamId;
+    uint64_t timeStamp;
+    uint64_t frame;         //!< chosen by the caller, e.g. the index of the frame in its stream
+};
+
+class FrameSynchronizer {
+public:
+    /** @brief called with one frame per camera in the order of the ids, under the lock of the synchronizer */
+    typedef std::function<void(const std::vector<SyncFrame>& group)> GroupCallback;
+
+    /**
+     * @param tolerance largest timestamp difference within a group
+     * @param depth frames kept per camera while waiting for the other cameras
+     */
+    FrameSynchronizer(const std::vector<uint32_t>& ids, uint64_t tolerance, const GroupCallback& callback,
+        size_t depth = 16);
+
+    /**
+     * @brief add the next frame of a camera, may be called from any thread
+     * @return false if the camera is unknown or the timestamp goes back
+     */
+    bool onFrame(uint32_t mcamId, uint64_t timeStamp, uint64_t frame);
+
+    uint64_t groups() const;
+    /** @brief frames discarded without a group */
+    uint64_t discarded() const;
+    const std::vector<uint32_t>& cameras() const { return ids; }
+
+private:
+    void match();
+
+    std::vector<uint32_t> ids;
+    std::unordered_map<uint32_t, size_t> index;
+    std::vector<std::deque<SyncFrame>> queues;
+    std::vector<SyncFrame> group;
+    uint64_t tolerance;
+    size_t depth;
+    GroupCallback callback;
+    uint64_t groupCount;
+    uint64_t discardCount;
+    mutable std::mutex mutex;
+};
+
+#endif // __FRAME_SYNCHRONIZER_H__
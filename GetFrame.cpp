@@ -17,12 +17,16 @@
 #include <iostream>
 #include <fstream>
 #include "mantis/MantisAPI.h"
+#include "FrameRecorder.h"
+#include "BitrateController.h"
+#include "PropertyLogger.h"
+#include "Topology.h"
 #include <string>
 #include <vector>
 #include <mutex>
+#include <algorithm>
 
 using namespace std;
-vector<FILE*> vOutFiles;
 
 mutex mutexM;
 
@@ -35,37 +39,16 @@ void newMCamCallback(MICRO_CAMERA mcam, void* data)
 }
 
 
-inline int getOutFileID(int camId){
-	char temp[10];
-	sprintf(temp, "%d", camId);
-	int l = strlen(temp);
-    if(l < 3) 
-        return camId;
-    int i = 1;
-	for(; i < l; i++){
-		if(temp[i] != 0) break;
-    }
-	return atoi(temp+i);
-}
-
-int count = 0;
-
-
-void mcamFrameCallback(FRAME frame, void* data)
-{
-	if(frame.m_metadata.m_tile == 0){ //when acosd starts with "-s 2", select differenct scales, 0: 3864x2174; 1:1920x1080, otherwise, only 0 is available
-		FILE** fileH = static_cast<FILE**>(data);
-		fwrite(frame.m_image, 1, frame.m_metadata.m_size, fileH[getOutFileID(frame.m_metadata.m_camId)]);
-		fwrite(&frame.m_metadata, 1, sizeof(frame.m_metadata), fileH[getOutFileID(frame.m_metadata.m_camId) + 19]);
-	}
-}
-
 void printHelp()
 {
     printf("Get frame stream:\n");
     printf("Usage:\n");
     printf("\t<Client Port> port connect from(default 13000)\n\n");
     printf("\t<Server Port> port connect to (default 9998)\n\n");
+    printf("Arguments: <output dir> <client port> <record time (s)> [writer threads] [queue frames]\n");
+    printf("\t[min bitrate (Mbit/s)] enables adaptive encoder bitrate control when > 0\n");
+    printf("\t[tap prefix] publishes received frames to shared memory /<tap prefix>_<mcam id>\n");
+    printf("\t[topology file] pins receiver and writer threads and places buffer pools on numa nodes\n\n");
 }
 
 int connectToIpsFromSyncFile(char fileName[], int sPort)
@@ -109,6 +92,25 @@ int main(int argc, char* argv[]){
 
     int recordtime = atoi(argv[3]);
 
+    RecorderConfig recorderConfig;
+    recorderConfig.dir = argv[1];
+    if (argc > 4)
+        recorderConfig.writerThreads = atoi(argv[4]);
+    if (argc > 5)
+        recorderConfig.queueFrames = atoi(argv[5]);
+    if (argc > 7)
+        recorderConfig.tapPrefix = argv[7];
+    TopologyConfig topology;
+    if (argc > 8) {
+        if (loadTopology(argv[8], topology) != 0)
+            exit(-1);
+        recorderConfig.placement = topology.writers;
+    }
+    RateControlConfig rateConfig;
+    bool rateControl = argc > 6 && atof(argv[6]) > 0;
+    if (rateControl)
+        rateConfig.minBitrate = (uint64_t)(atof(argv[6]) * 1e6);
+
     // make dir
     char cmd[200];
     sprintf(cmd, "mkdir %s", argv[1]);
@@ -134,34 +136,49 @@ int main(int argc, char* argv[]){
     setNewMCamCallback(mcamCB);
 
     /* Next we set a callback function to receive the stream of frames
-     * from the desired microcamera */
-    MICRO_CAMERA_FRAME_CALLBACK frameCB;
-    frameCB.f = mcamFrameCallback;
-
-    //Set output file handles
-    char fileName[256] = {0};
-    char fileNameConfig[256] = {0};
-    vOutFiles.resize(numMCams * 2); 
-
+     * from the desired microcamera, the callback only queues the frames
+     * and the recorder's writer threads save them to disk */
+    /* size the frame buffer pools for the highest bitrate and frame rate configured */
+    for (int i = 0; i < numMCams; i++){
+        AtlCompressionParameters cp = getMCamCompressionParameters(mcamList[i]);
+        printf("CameraId: %d encodes %s\n", mcamList[i].mcamID,
+            cp.type == ATL_COMPRESSION_TYPE_H265 ? "h265" : cp.type == ATL_COMPRESSION_TYPE_H264 ? "h264" : "other");
+        recorderConfig.expectedBitrate = std::max<uint64_t>(recorderConfig.expectedBitrate, cp.target_bitrate);
+        double fps = getMCamFramerate(mcamList[i]);
+        if (i == 0 || fps > recorderConfig.expectedFps)
+            recorderConfig.expectedFps = fps;
+    }
+    FrameRecorder recorder(recorderConfig);
     for (int i = 0; i < numMCams; i++){
-
 	    printf("CameraId: %d\n", mcamList[i].mcamID);
-	    sprintf(fileName,"%s/mcam_%d", argv[1], mcamList[i].mcamID);
-	    sprintf(fileNameConfig,"%s/mcam_config_%d", argv[1], mcamList[i].mcamID);
-	    int fileId = getOutFileID(mcamList[i].mcamID);
-
-        // if(fileId >= vOutFiles.size()) {
-        //     vOutFiles.resize((fileId + 1) * 2);
-        // }
-	    
-        vOutFiles[fileId] = fopen(fileName, "wb");
-        vOutFiles[fileId + numMCams] = fopen(fileNameConfig, "wb");
-	    printf("Camera %d saved to %s fileID:%d\n", mcamList[i].mcamID, fileName, fileId);
-	    printf("Camera config file %d saved to %s fileID:%d\n", mcamList[i].mcamID, fileNameConfig, fileId);
+        if (recorder.addCamera(mcamList[i].mcamID) != 0)
+            exit(-1);
+    }
+    recorder.start();
+
+    /* optionally trade encoder quality for bandwidth when the disk falls behind */
+    MICRO_CAMERA* mcams = mcamList;
+    BitrateController rateController(recorder, rateConfig,
+        [mcams, numMCams](uint32_t mcamId, const AtlCompressionParameters& cp) {
+            for (int i = 0; i < numMCams; i++)
+                if (mcams[i].mcamID == mcamId)
+                    return setMCamCompressionParameters(mcams[i], cp);
+            return false;
+        });
+    if (rateControl) {
+        for (int i = 0; i < numMCams; i++)
+            rateController.addCamera(mcamList[i].mcamID, getMCamCompressionParameters(mcamList[i]));
+        rateController.start();
     }
 
-    frameCB.data = (void*)&vOutFiles[0];
+    MICRO_CAMERA_FRAME_CALLBACK frameCB;
+    frameCB.f = FrameRecorder::frameCallback;
+    frameCB.data = (void*)&recorder;
     setMCamFrameCallback(frameCB);
+    /* the receive threads of the API inherit the cpus of the thread creating them */
+    std::vector<int> mainCpus = threadCpus(pthread_self());
+    if (!topology.receiverCpus.empty())
+        pinThread(pthread_self(), topology.receiverCpus);
     for (int i = 0; i < numMCams; i++){
 	    initMCamFrameReceiver( cPort+i, 1 );
     }
@@ -187,12 +204,28 @@ int main(int argc, char* argv[]){
 	    //}
 	    sleep(0.2);
     }
+    if (!topology.receiverCpus.empty())
+        pinThread(pthread_self(), mainCpus);
+    if (argc > 8) {
+        printf("Thread placement:\n");
+        recorder.printPlacement(stdout);
+        printThreadPlacement(stdout);
+        if (!topology.nic.empty())
+            printNicPlacement(stdout, topology.nic);
+    }
+
+    /* log exposure, gain, shutter, white balance and focus changes during recording */
+    PropertyLogger propertyLogger(recorderConfig.dir, &recorder);
+    propertyLogger.start(mcamList, numMCams);
 
     //char a;
     //scanf("%c", &a);
     usleep(recordtime * 1e6);
 
+    propertyLogger.stop();
+
     printf("start to stop streaming!\n");
+    rateController.stop();
 
     for (int i = 0; i < numMCams; i++){
         //Stop the stream
@@ -206,11 +239,20 @@ int main(int argc, char* argv[]){
     	closeMCamFrameReceiver( cPort+i );
     }
 
-    //close output file handles
+    //flush queued frames and close output file handles
+    recorder.stop();
+    std::vector<CameraStats> stats = recorder.cameraStats();
+    for (size_t i = 0; i < stats.size(); i++){
+        printf("CAM: %u received %llu frames, written %llu frames, dropped %llu frames\n", stats[i].mcamId,
+            (unsigned long long)stats[i].received, (unsigned long long)stats[i].written,
+            (unsigned long long)stats[i].dropped);
+    }
+    PoolStats pool = recorder.poolStats();
+    printf("Frame buffer pool: %.1f MB%s, %llu frames, %llu from larger buffers, %llu from heap\n",
+        pool.arenaBytes / 1e6, pool.hugePages ? " huge pages" : "", (unsigned long long)pool.allocations,
+        (unsigned long long)pool.spills, (unsigned long long)pool.misses);
+
     for (int i = 0; i < numMCams; i++){
-	    fclose(vOutFiles[getOutFileID(mcamList[i].mcamID)]);
-	    fclose(vOutFiles[getOutFileID(mcamList[i].mcamID) + 19]);
-    
         AtlWhiteBalance wb = getMCamWhiteBalance(mcamList[i]);
 	    printf("CAM: %d after-- red: %f green: %f blue: %f\n",mcamList[i].mcamID, wb.red, wb.green, wb.blue);
     }
@@ -0,0 +1,254 @@
+#include "NalParser.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define NAL_SCAN_SSE2
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define NAL_SCAN_NEON
+#endif
+
+static const uint8_t* findStartCodeScalar(const uint8_t* p, const uint8_t* end) {
+    for (; p + 3 <= end; p ++) {
+        // the third byte decides most positions, skip ahead by what it rules out
+        if (p[2] > 1)
+            p += 2;
+        else if (p[2] == 1 && p[1] == 0 && p[0] == 0)
+            return p;
+    }
+    return end;
+}
+
+const uint8_t* findStartCode(const uint8_t* begin, const uint8_t* end) {
+    const uint8_t* p = begin;
+#if defined(NAL_SCAN_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi8(1);
+    // 16 candidate positions per step, a hit needs bytes i, i + 1 and i + 2
+    for (; p + 18 <= end; p += 16) {
+        __m128i b0 = _mm_loadu_si128((const __m128i*)p);
+        __m128i b1 = _mm_loadu_si128((const __m128i*)(p + 1));
+        __m128i b2 = _mm_loadu_si128((const __m128i*)(p + 2));
+        __m128i hit = _mm_and_si128(_mm_and_si128(_mm_cmpeq_epi8(b0, zero), _mm_cmpeq_epi8(b1, zero)),
+            _mm_cmpeq_epi8(b2, one));
+        int mask = _mm_movemask_epi8(hit);
+        if (mask)
+            return p + __builtin_ctz(mask);
+    }
+#elif defined(NAL_SCAN_NEON)
+    const uint8x16_t zero = vdupq_n_u8(0);
+    const uint8x16_t one = vdupq_n_u8(1);
+    for (; p + 18 <= end; p += 16) {
+        uint8x16_t hit = vandq_u8(vandq_u8(vceqq_u8(vld1q_u8(p), zero), vceqq_u8(vld1q_u8(p + 1), zero)),
+            vceqq_u8(vld1q_u8(p + 2), one));
+        if (vmaxvq_u8(hit)) {
+            for (int i = 0; ; i ++)
+                if (p[i] == 0 && p[i + 1] == 0 && p[i + 2] == 1)
+                    return p + i;
+        }
+    }
+#endif
+    return findStartCodeScalar(p, end);
+}
+
+const char* startCodeScanImplementation() {
+#if defined(NAL_SCAN_SSE2)
+    return "sse2";
+#elif defined(NAL_SCAN_NEON)
+    return "neon";
+#else
+    return "scalar";
+#endif
+}
+
+size_t parseNalUnits(const uint8_t* data, size_t size, int codec, std::vector<NalUnit>& units) {
+    units.clear();
+    const uint8_t* end = data + size;
+    const uint8_t* start = findStartCode(data, end);
+    while (start < end) {
+        const uint8_t* nal = start + 3;
+        const uint8_t* next = findStartCode(nal, end);
+        // zeros in front of the next start code are its zero_byte or trailing_zero_8bits
+        const uint8_t* nalEnd = next;
+        while (nalEnd > nal && nalEnd[-1] == 0)
+            nalEnd --;
+        if (nalEnd > nal) {
+            NalUnit unit;
+            unit.offset = nal - data;
+            unit.size = nalEnd - nal;
+            unit.type = codec == CODEC_HEVC ? (nal[0] >> 1) & 0x3f : nal[0] & 0x1f;
+            unit.startCode = start > data && start[-1] == 0 ? 4 : 3;
+            units.push_back(unit);
+        }
+        start = next;
+    }
+    return units.size();
+}
+
+static void classifyHevc(FrameNals& frame) {
+    for (size_t i = 0; i < frame.units.size(); i ++) {
+        int type = frame.units[i].type;
+        if (type >= HEVC_NAL_BLA_W_LP && type <= HEVC_NAL_CRA)
+            frame.frameType = FRAME_IDR;
+        else if (type <= HEVC_NAL_RASL_R) {
+            if (frame.frameType == FRAME_UNKNOWN)
+                frame.frameType = FRAME_NON_IDR;
+        }
+        else if (type == HEVC_NAL_VPS)
+            frame.hasVps = true;
+        else if (type == HEVC_NAL_SPS)
+            frame.hasSps = true;
+        else if (type == HEVC_NAL_PPS)
+            frame.hasPps = true;
+        else if (type == HEVC_NAL_PREFIX_SEI || type == HEVC_NAL_SUFFIX_SEI)
+            frame.hasSei = true;
+    }
+}
+
+void parseFrame(const uint8_t* data, size_t size, int codec, FrameNals& frame) {
+    parseNalUnits(data, size, codec, frame.units);
+    frame.frameType = FRAME_UNKNOWN;
+    frame.hasVps = false;
+    frame.hasSps = false;
+    frame.hasPps = false;
+    frame.hasSei = false;
+    if (codec == CODEC_HEVC) {
+        classifyHevc(frame);
+        return;
+    }
+    for (size_t i = 0; i < frame.units.size(); i ++) {
+        switch (frame.units[i].type) {
+        case NAL_IDR:
+            frame.frameType = FRAME_IDR;
+            break;
+        case NAL_SLICE:
+            if (frame.frameType == FRAME_UNKNOWN)
+                frame.frameType = FRAME_NON_IDR;
+            break;
+        case NAL_SPS:
+            frame.hasSps = true;
+            break;
+        case NAL_PPS:
+            frame.hasPps = true;
+            break;
+        case NAL_SEI:
+            frame.hasSei = true;
+            break;
+        }
+    }
+}
+
+bool startsAccessUnit(const uint8_t* nal, int codec, bool& sliceSeen) {
+    bool slice;
+    bool firstSlice;
+    bool prefix;
+    if (codec == CODEC_HEVC) {
+        int type = (nal[0] >> 1) & 0x3f;
+        slice = type < HEVC_NAL_VPS;
+        // first_slice_segment_in_pic_flag
+        firstSlice = slice && (nal[2] & 0x80);
+        prefix = (type >= HEVC_NAL_VPS && type <= HEVC_NAL_AUD) || type == HEVC_NAL_PREFIX_SEI ||
+            (type >= 41 && type <= 44) || (type >= 48 && type <= 55);
+    }
+    else {
+        int type = nal[0] & 0x1f;
+        slice = type >= NAL_SLICE && type <= NAL_IDR;
+        // first_mb_in_slice is ue(v) coded, 0 is a single 1 bit, partitions B and C have none
+        firstSlice = slice && type != 3 && type != 4 && (nal[1] & 0x80);
+        prefix = (type >= NAL_SEI && type <= NAL_AUD) || (type >= 14 && type <= 18);
+    }
+    bool starts = sliceSeen && (prefix || firstSlice);
+    if (starts)
+        sliceSeen = false;
+    if (slice)
+        sliceSeen = true;
+    return starts;
+}
+
+int detectCodec(const uint8_t* data, size_t size) {
+    std::vector<NalUnit> units;
+    parseNalUnits(data, size, CODEC_H264, units);
+    // count the NAL headers that are plausible for each codec, e.g. an h264
+    // SPS (0x67) is nal_unit_type 51 in h265 which is unspecified
+    int h264 = 0;
+    int hevc = 0;
+    for (size_t i = 0; i < units.size(); i ++) {
+        const uint8_t* nal = data + units[i].offset;
+        if (nal[0] & 0x80)
+            continue;
+        int refIdc = nal[0] >> 5;
+        int type = nal[0] & 0x1f;
+        if (type == NAL_SLICE ||
+            ((type == NAL_IDR || type == NAL_SPS || type == NAL_PPS) && refIdc != 0) ||
+            ((type == NAL_SEI || type == NAL_AUD) && refIdc == 0))
+            h264++;
+        if (units[i].size >= 2) {
+            int hevcType = (nal[0] >> 1) & 0x3f;
+            int layer = ((nal[0] & 1) << 5) | (nal[1] >> 3);
+            int temporalId = nal[1] & 7;
+            if (layer == 0 && temporalId != 0 && (hevcType <= HEVC_NAL_RASL_R ||
+                (hevcType >= HEVC_NAL_BLA_W_LP && hevcType <= HEVC_NAL_CRA) ||
+                (hevcType >= HEVC_NAL_VPS && hevcType <= HEVC_NAL_SUFFIX_SEI)))
+                hevc++;
+        }
+    }
+    if (h264 == 0 && hevc == 0)
+        return CODEC_UNKNOWN;
+    return hevc > h264 ? CODEC_HEVC : CODEC_H264;
+}
+
+const char* codecName(int codec) {
+    switch (codec) {
+    case CODEC_H264: return "h264";
+    case CODEC_HEVC: return "h265";
+    default: return "unknown";
+    }
+}
+
+static const char* hevcNalTypeName(int type) {
+    if (type <= HEVC_NAL_RASL_R)
+        return "SLICE";
+    switch (type) {
+    case HEVC_NAL_BLA_W_LP:
+    case HEVC_NAL_BLA_W_LP + 1:
+    case HEVC_NAL_BLA_W_LP + 2: return "BLA";
+    case HEVC_NAL_IDR_W_RADL:
+    case HEVC_NAL_IDR_N_LP: return "IDR";
+    case HEVC_NAL_CRA: return "CRA";
+    case HEVC_NAL_VPS: return "VPS";
+    case HEVC_NAL_SPS: return "SPS";
+    case HEVC_NAL_PPS: return "PPS";
+    case HEVC_NAL_AUD: return "AUD";
+    case 36: return "EOSEQ";
+    case 37: return "EOSTREAM";
+    case 38: return "FILLER";
+    case HEVC_NAL_PREFIX_SEI:
+    case HEVC_NAL_SUFFIX_SEI: return "SEI";
+    default: return "OTHER";
+    }
+}
+
+const char* nalTypeName(int codec, int type) {
+    if (codec == CODEC_HEVC)
+        return hevcNalTypeName(type);
+    switch (type) {
+    case NAL_SLICE: return "SLICE";
+    case NAL_IDR: return "IDR";
+    case NAL_SEI: return "SEI";
+    case NAL_SPS: return "SPS";
+    case NAL_PPS: return "PPS";
+    case NAL_AUD: return "AUD";
+    case 10: return "EOSEQ";
+    case 11: return "EOSTREAM";
+    case 12: return "FILLER";
+    default: return "OTHER";
+    }
+}
+
+const char* frameTypeName(int type) {
+    switch (type) {
+    case FRAME_IDR: return "IDR";
+    case FRAME_NON_IDR: return "NON_IDR";
+    default: return "UNKNOWN";
+    }
+}
@@ -0,0 +1,114 @@
+/**
+ * @file NalParser.h
+ * @brief Annex-B NAL unit parser for the recorded h264 and h265 streams
+ *
+ * Every frame in mcam_<id> is one access unit in Annex-B byte stream format:
+ * NAL units separated by 3 byte (00 00 01) or 4 byte (00 00 00 01) start
+ * codes. The start code scan uses SSE2 or NEON and checks 16 positions per
+ * step, so whole multi-GB streams can be parsed at memory speed. The codec
+ * is not recorded in the session, detectCodec tells it from the NAL headers.
+ */
+#ifndef __NAL_PARSER_H__
+#define __NAL_PARSER_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+enum Codec {
+    CODEC_UNKNOWN = 0,
+    CODEC_H264 = 1,
+    CODEC_HEVC = 2,
+};
+
+/**
+ * @brief h264 nal_unit_type values used by the tools
+ */
+enum NalType {
+    NAL_SLICE = 1,          //!< coded slice of a non-IDR picture
+    NAL_IDR = 5,            //!< coded slice of an IDR picture
+    NAL_SEI = 6,
+    NAL_SPS = 7,
+    NAL_PPS = 8,
+    NAL_AUD = 9,            //!< access unit delimiter
+};
+
+/**
+ * @brief h265 nal_unit_type values used by the tools
+ */
+enum HevcNalType {
+    HEVC_NAL_TRAIL_N = 0,   //!< 0 - 9 are slices of non IRAP pictures
+    HEVC_NAL_RASL_R = 9,
+    HEVC_NAL_BLA_W_LP = 16, //!< 16 - 21 are slices of IRAP pictures
+    HEVC_NAL_IDR_W_RADL = 19,
+    HEVC_NAL_IDR_N_LP = 20,
+    HEVC_NAL_CRA = 21,
+    HEVC_NAL_VPS = 32,
+    HEVC_NAL_SPS = 33,
+    HEVC_NAL_PPS = 34,
+    HEVC_NAL_AUD = 35,
+    HEVC_NAL_PREFIX_SEI = 39,
+    HEVC_NAL_SUFFIX_SEI = 40,
+};
+
+enum FrameType {
+    FRAME_UNKNOWN = 0,      //!< no slice found
+    FRAME_IDR = 1,          //!< random access point (h264 IDR, h265 IRAP), decoding can start here
+    FRAME_NON_IDR = 2,
+};
+
+struct NalUnit {
+    size_t offset;          //!< offset of the NAL header byte in the frame
+    size_t size;            //!< bytes from the NAL header to the next start code
+    uint8_t type;           //!< nal_unit_type of the codec
+    uint8_t startCode;      //!< length of the start code in front of it, 3 or 4
+};
+
+/**
+ * @brief NAL units of one frame and what they contain
+ */
+struct FrameNals {
+    std::vector<NalUnit> units;
+    int frameType;          //!< FrameType
+    bool hasVps;            //!< h265 only
+    bool hasSps;
+    bool hasPps;
+    bool hasSei;
+};
+
+/**
+ * @brief first 00 00 01 in [begin, end)
+ * @return pointer to its first zero byte, end if there is none
+ */
+const uint8_t* findStartCode(const uint8_t* begin, const uint8_t* end);
+
+/**
+ * @brief split an Annex-B buffer into NAL units, bytes before the first start code are skipped
+ * @return number of NAL units
+ */
+size_t parseNalUnits(const uint8_t* data, size_t size, int codec, std::vector<NalUnit>& units);
+
+/** @brief parse the NAL units of a frame and classify it */
+void parseFrame(const uint8_t* data, size_t size, int codec, FrameNals& frame);
+
+/**
+ * @brief tell whether a NAL unit starts a new access unit, i.e. a frame of the stream
+ * @param nal NAL header, 3 bytes must be readable
+ * @param sliceSeen whether the current access unit holds a slice, updated for this NAL unit
+ */
+bool startsAccessUnit(const uint8_t* nal, int codec, bool& sliceSeen);
+
+/**
+ * @brief tell h264 from h265 by the NAL headers of a frame
+ * @return CODEC_UNKNOWN if the frame has no NAL unit that is valid for either
+ */
+int detectCodec(const uint8_t* data, size_t size);
+
+const char* codecName(int codec);
+const char* nalTypeName(int codec, int type);
+const char* frameTypeName(int type);
+
+/** @brief "sse2", "neon" or "scalar" */
+const char* startCodeScanImplementation();
+
+#endif // __NAL_PARSER_H__
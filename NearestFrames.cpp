@@ -0,0 +1,162 @@
+#include "NearestFrames.h"
+#include "TimeStamps.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define NEAREST_AVX2
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define NEAREST_NEON
+#endif
+
+// timestamps stay below 2^63, so they are compared as signed 64 bit lanes
+
+static void findScalar(const int64_t* data, size_t count, int64_t t, int64_t* cursor, const int64_t* last,
+    int64_t* nearest, uint64_t* distance) {
+    for (size_t i = 0; i < count; i ++) {
+        int64_t c = cursor[i];
+        for (;;) {
+            int64_t more = c < last[i];
+            int64_t advance = more & (data[c + more] <= t);
+            if (!advance)
+                break;
+            c += advance;
+        }
+        int64_t n = c + (c < last[i]);
+        int64_t da = data[c] - t;
+        int64_t db = data[n] - t;
+        da = da < 0 ? -da : da;
+        db = db < 0 ? -db : db;
+        int64_t useNext = db < da;
+        cursor[i] = c;
+        nearest[i] = c + ((n - c) & -useNext);
+        distance[i] = (uint64_t)(da + ((db - da) & -useNext));
+    }
+}
+
+#if defined(NEAREST_AVX2)
+__attribute__((target("avx2")))
+static inline __m256i absDiff(__m256i a, __m256i t) {
+    __m256i diff = _mm256_sub_epi64(a, t);
+    __m256i negative = _mm256_cmpgt_epi64(_mm256_setzero_si256(), diff);
+    return _mm256_sub_epi64(_mm256_xor_si256(diff, negative), negative);
+}
+
+__attribute__((target("avx2")))
+static void findAvx2(const int64_t* data, size_t count, int64_t t, int64_t* cursor, const int64_t* last,
+    int64_t* nearest, uint64_t* distance) {
+    const long long* base = (const long long*)data;
+    const __m256i target = _mm256_set1_epi64x(t);
+    for (size_t i = 0; i < count; i += 4) {
+        __m256i c = _mm256_loadu_si256((const __m256i*)(cursor + i));
+        __m256i l = _mm256_loadu_si256((const __m256i*)(last + i));
+        __m256i a = _mm256_i64gather_epi64(base, c, 8);
+        __m256i more, n, next;
+        // advance every lane whose next frame is not after the target, one frame per round,
+        // the timestamps gathered in the last round are those of the next frames
+        for (;;) {
+            more = _mm256_cmpgt_epi64(l, c);
+            n = _mm256_sub_epi64(c, more);
+            next = _mm256_i64gather_epi64(base, n, 8);
+            __m256i advance = _mm256_andnot_si256(_mm256_cmpgt_epi64(next, target), more);
+            if (_mm256_testz_si256(advance, advance))
+                break;
+            c = _mm256_sub_epi64(c, advance);
+            a = _mm256_blendv_epi8(a, next, advance);
+        }
+        __m256i da = absDiff(a, target);
+        __m256i db = absDiff(next, target);
+        __m256i useNext = _mm256_cmpgt_epi64(da, db);
+        _mm256_storeu_si256((__m256i*)(cursor + i), c);
+        _mm256_storeu_si256((__m256i*)(nearest + i), _mm256_blendv_epi8(c, n, useNext));
+        _mm256_storeu_si256((__m256i*)(distance + i), _mm256_blendv_epi8(da, db, useNext));
+    }
+}
+#endif
+
+#if defined(NEAREST_NEON)
+static inline int64x2_t gather(const int64_t* data, int64x2_t index) {
+    return vcombine_s64(vld1_s64(data + vgetq_lane_s64(index, 0)), vld1_s64(data + vgetq_lane_s64(index, 1)));
+}
+
+static void findNeon(const int64_t* data, size_t count, int64_t t, int64_t* cursor, const int64_t* last,
+    int64_t* nearest, uint64_t* distance) {
+    const int64x2_t target = vdupq_n_s64(t);
+    for (size_t i = 0; i < count; i += 2) {
+        int64x2_t c = vld1q_s64(cursor + i);
+        int64x2_t l = vld1q_s64(last + i);
+        int64x2_t a = gather(data, c);
+        uint64x2_t more;
+        int64x2_t n, next;
+        for (;;) {
+            more = vcgtq_s64(l, c);
+            n = vsubq_s64(c, vreinterpretq_s64_u64(more));
+            next = gather(data, n);
+            uint64x2_t advance = vbicq_u64(more, vcgtq_s64(next, target));
+            if ((vgetq_lane_u64(advance, 0) | vgetq_lane_u64(advance, 1)) == 0)
+                break;
+            c = vsubq_s64(c, vreinterpretq_s64_u64(advance));
+            a = vbslq_s64(advance, next, a);
+        }
+        int64x2_t da = vabsq_s64(vsubq_s64(a, target));
+        int64x2_t db = vabsq_s64(vsubq_s64(next, target));
+        uint64x2_t useNext = vcgtq_s64(da, db);
+        vst1q_s64(cursor + i, c);
+        vst1q_s64(nearest + i, vbslq_s64(useNext, n, c));
+        vst1q_u64(distance + i, vreinterpretq_u64_s64(vbslq_s64(useNext, db, da)));
+    }
+}
+#endif
+
+NearestFrames::NearestFrames(const TimeStampTable& table, bool vectorized) : table(table), lanes(1) {
+#if defined(NEAREST_AVX2)
+    if (vectorized && __builtin_cpu_supports("avx2"))
+        lanes = 4;
+#elif defined(NEAREST_NEON)
+    if (vectorized)
+        lanes = 2;
+#endif
+    size_t cameras = table.cameras();
+    padded = (cameras + lanes - 1) / lanes * lanes;
+    // lanes of padding and of cameras without frames stay on timestamp 0 of the table
+    first.assign(padded, 0);
+    last.assign(padded, 0);
+    for (size_t i = 0; i < cameras; i ++) {
+        if (table.size((int)i) == 0)
+            continue;
+        first[i] = (int64_t)table.offsets[i];
+        last[i] = (int64_t)table.offsets[i + 1] - 1;
+    }
+    cursor = first;
+    nearest.assign(padded, 0);
+    distance.assign(padded, 0);
+}
+
+void NearestFrames::reset() {
+    cursor = first;
+}
+
+void NearestFrames::find(uint64_t t, int* frames, uint64_t* distances) {
+    int cameras = table.cameras();
+    if (!table.data.empty()) {
+        const int64_t* data = (const int64_t*)&table.data[0];
+#if defined(NEAREST_AVX2)
+        if (lanes == 4)
+            findAvx2(data, padded, (int64_t)t, &cursor[0], &last[0], &nearest[0], &distance[0]);
+#elif defined(NEAREST_NEON)
+        if (lanes == 2)
+            findNeon(data, padded, (int64_t)t, &cursor[0], &last[0], &nearest[0], &distance[0]);
+#endif
+        if (lanes == 1)
+            findScalar(data, padded, (int64_t)t, &cursor[0], &last[0], &nearest[0], &distance[0]);
+    }
+    for (int i = 0; i < cameras; i ++) {
+        bool empty = table.size(i) == 0;
+        frames[i] = empty ? -1 : (int)(nearest[i] - first[i]);
+        distances[i] = empty ? UINT64_MAX : distance[i];
+    }
+}
+
+const char* NearestFrames::implementation() const {
+    return lanes == 4 ? "avx2" : lanes == 2 ? "neon" : "scalar";
+}
@@ -0,0 +1,49 @@
+/**
+ * @file NearestFrames.h
+ * @brief nearest frame of every camera to a target time, over the timestamp
+ *        columns of a TimeStampTable
+ *
+ * Every camera has a cursor that only moves forward, so the targets must not
+ * decrease between calls and a pass over a session is linear in its frames.
+ * The cursors of all cameras are advanced and compared together without
+ * branches per camera: with AVX2 (selected at runtime) four cameras per
+ * vector gather their timestamps from the contiguous table, with NEON two,
+ * and a scalar loop does the same otherwise.
+ */
+#ifndef __NEAREST_FRAMES_H__
+#define __NEAREST_FRAMES_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+struct TimeStampTable;
+
+class NearestFrames {
+public:
+    /** @param vectorized false forces the scalar implementation, e.g. for benchmarks */
+    explicit NearestFrames(const TimeStampTable& table, bool vectorized = true);
+
+    /**
+     * @brief nearest frame of every camera to t, the earlier frame on a tie
+     * @param frames frame number per camera, -1 for cameras without frames
+     * @param distances |timestamp - t| per camera, UINT64_MAX for cameras without frames
+     */
+    void find(uint64_t t, int* frames, uint64_t* distances);
+    /** @brief move all cursors back to the first frames */
+    void reset();
+    /** @brief "avx2", "neon" or "scalar" */
+    const char* implementation() const;
+
+private:
+    const TimeStampTable& table;
+    int lanes;                          // cameras per vector, 1 for scalar
+    size_t padded;                      // cameras rounded up to lanes
+    std::vector<int64_t> cursor;        // index into table.data of the frame at or before the last target
+    std::vector<int64_t> last;          // index of the last frame of every camera
+    std::vector<int64_t> first;         // index of the first frame of every camera
+    std::vector<int64_t> nearest;
+    std::vector<uint64_t> distance;
+};
+
+#endif // __NEAREST_FRAMES_H__
@@ -0,0 +1,129 @@
+#include "PropertyLogger.h"
+
+#include <string.h>
+#include <sys/time.h>
+
+PropertyLogger::PropertyLogger(const std::string& dir, FrameRecorder* recorder) :
+    dir(dir), recorder(recorder), fp(NULL), numRecords(0) {}
+
+PropertyLogger::~PropertyLogger() {
+    stop();
+}
+
+int PropertyLogger::start(const MICRO_CAMERA* list, int numMCams) {
+    std::string fileName = propertyLogFileName(dir);
+    fp = fopen(fileName.c_str(), "wb");
+    if (fp == NULL) {
+        printf("Open property log %s failed!\n", fileName.c_str());
+        return -1;
+    }
+    mcams.assign(list, list + numMCams);
+    last.resize(numMCams);
+    for (int i = 0; i < numMCams; i ++) {
+        memset(&last[i], 0, sizeof(Last));
+        last[i].mcamId = mcams[i].mcamID;
+    }
+
+    for (int i = 0; i < numMCams; i ++) {
+        uint32_t id = mcams[i].mcamID;
+        double value[3];
+        value[0] = getMCamExposure(mcams[i]);
+        log(id, PROPERTY_EXPOSURE, value, 1, true);
+        value[0] = getMCamGain(mcams[i]);
+        log(id, PROPERTY_GAIN, value, 1, true);
+        value[0] = getMCamShutter(mcams[i]);
+        log(id, PROPERTY_SHUTTER, value, 1, true);
+        AtlWhiteBalance wb = getMCamWhiteBalance(mcams[i]);
+        value[0] = wb.red;
+        value[1] = wb.green;
+        value[2] = wb.blue;
+        log(id, PROPERTY_WHITE_BALANCE, value, 3, true);
+        value[0] = getMCamFocus(mcams[i]);
+        log(id, PROPERTY_FOCUS, value, 1, true);
+    }
+
+    MICRO_CAMERA_CALLBACKS callbacks;
+    memset(&callbacks, 0, sizeof(callbacks));
+    callbacks.exposureCallback.f = onExposure;
+    callbacks.exposureCallback.data = this;
+    callbacks.gainCallback.f = onGain;
+    callbacks.gainCallback.data = this;
+    callbacks.shutterCallback.f = onShutter;
+    callbacks.shutterCallback.data = this;
+    callbacks.focusCallback.f = onFocus;
+    callbacks.focusCallback.data = this;
+    callbacks.whiteBalanceCallback.f = onWhiteBalance;
+    callbacks.whiteBalanceCallback.data = this;
+    for (int i = 0; i < numMCams; i ++)
+        setMCamPropertyCallbacks(mcams[i], callbacks);
+    printf("Log camera properties of %d microcameras to %s\n", numMCams, fileName.c_str());
+    return 0;
+}
+
+void PropertyLogger::stop() {
+    if (fp == NULL)
+        return;
+    MICRO_CAMERA_CALLBACKS callbacks;
+    memset(&callbacks, 0, sizeof(callbacks));
+    for (size_t i = 0; i < mcams.size(); i ++)
+        setMCamPropertyCallbacks(mcams[i], callbacks);
+    std::lock_guard<std::mutex> guard(mutex);
+    fclose(fp);
+    fp = NULL;
+}
+
+void PropertyLogger::log(uint32_t mcamId, int property, const double* value, int count, bool initial) {
+    std::lock_guard<std::mutex> guard(mutex);
+    if (fp == NULL)
+        return;
+    Last* l = NULL;
+    for (size_t i = 0; i < last.size(); i ++) {
+        if (last[i].mcamId == mcamId) {
+            l = &last[i];
+            break;
+        }
+    }
+    if (l == NULL)
+        return;
+    // callbacks may fire for writes of an unchanged value, keep only changes
+    if (l->valid[property] && memcmp(l->value[property], value, sizeof(double) * count) == 0)
+        return;
+    l->valid[property] = true;
+    memcpy(l->value[property], value, sizeof(double) * count);
+
+    PropertyRecord record;
+    memset(&record, 0, sizeof(record));
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    record.time = (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+    record.timestamp = recorder ? recorder->receivedTimestamp(mcamId) : 0;
+    record.mcamId = mcamId;
+    record.property = (uint16_t)property;
+    record.initial = initial ? 1 : 0;
+    memcpy(record.value, value, sizeof(double) * count);
+    fwrite(&record, sizeof(record), 1, fp);
+    // changes are rare, flush so the log survives a crash of the recorder
+    fflush(fp);
+    numRecords++;
+}
+
+void PropertyLogger::onExposure(MICRO_CAMERA mcam, void* data, double o, double n) {
+    static_cast<PropertyLogger*>(data)->log(mcam.mcamID, PROPERTY_EXPOSURE, &n, 1, false);
+}
+
+void PropertyLogger::onGain(MICRO_CAMERA mcam, void* data, double o, double n) {
+    static_cast<PropertyLogger*>(data)->log(mcam.mcamID, PROPERTY_GAIN, &n, 1, false);
+}
+
+void PropertyLogger::onShutter(MICRO_CAMERA mcam, void* data, double o, double n) {
+    static_cast<PropertyLogger*>(data)->log(mcam.mcamID, PROPERTY_SHUTTER, &n, 1, false);
+}
+
+void PropertyLogger::onFocus(MICRO_CAMERA mcam, void* data, double o, double n) {
+    static_cast<PropertyLogger*>(data)->log(mcam.mcamID, PROPERTY_FOCUS, &n, 1, false);
+}
+
+void PropertyLogger::onWhiteBalance(MICRO_CAMERA mcam, void* data, AtlWhiteBalance o, AtlWhiteBalance n) {
+    double value[3] = { n.red, n.green, n.blue };
+    static_cast<PropertyLogger*>(data)->log(mcam.mcamID, PROPERTY_WHITE_BALANCE, value, 3, false);
+}
@@ -0,0 +1,59 @@
+/**
+ * @file PropertyLogger.h
+ * @brief logs every change of exposure, gain, shutter, white balance and focus
+ *        of the mcams into the session's property_log
+ *
+ * The current values are read once when logging starts, afterwards the
+ * MantisAPI property callbacks append a PropertyRecord whenever a value
+ * actually changes. Records carry the host time and the timestamp of the
+ * last frame received from the mcam so they can be matched to frames.
+ */
+#ifndef __PROPERTY_LOGGER_H__
+#define __PROPERTY_LOGGER_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <mutex>
+#include "mantis/MantisAPI.h"
+#include "SessionFiles.h"
+#include "FrameRecorder.h"
+
+class PropertyLogger {
+public:
+    /** @param recorder optional, provides the frame timestamps of the records */
+    PropertyLogger(const std::string& dir, FrameRecorder* recorder);
+    ~PropertyLogger();
+
+    /** @brief log the current values and register the property callbacks of the mcams */
+    int start(const MICRO_CAMERA* mcams, int numMCams);
+    /** @brief unregister the callbacks and close the log */
+    void stop();
+    uint64_t records() const { return numRecords; }
+
+private:
+    struct Last {
+        uint32_t mcamId;
+        bool valid[NUM_PROPERTIES];
+        double value[NUM_PROPERTIES][3];
+    };
+
+    void log(uint32_t mcamId, int property, const double* value, int count, bool initial);
+
+    static void onExposure(MICRO_CAMERA mcam, void* data, double o, double n);
+    static void onGain(MICRO_CAMERA mcam, void* data, double o, double n);
+    static void onShutter(MICRO_CAMERA mcam, void* data, double o, double n);
+    static void onFocus(MICRO_CAMERA mcam, void* data, double o, double n);
+    static void onWhiteBalance(MICRO_CAMERA mcam, void* data, AtlWhiteBalance o, AtlWhiteBalance n);
+
+    std::string dir;
+    FrameRecorder* recorder;
+    std::vector<MICRO_CAMERA> mcams;
+    std::vector<Last> last;
+    std::mutex mutex;
+    FILE* fp;
+    uint64_t numRecords;
+};
+
+#endif // __PROPERTY_LOGGER_H__
@@ -0,0 +1,456 @@
+/******************************************************************************
+ *
+ * RecordBenchmark.cpp
+ *
+ * Sustained-throughput benchmark of the recording pipeline. A simulated (or
+ * replayed) frame source feeds FrameRecorder the same way the MantisAPI
+ * receiver threads do, one thread per camera. For every combination of camera
+ * count, bitrate, scale count and writer configuration it reports the
+ * throughput at the nominal frame rate, the maximum sustained frame rate
+ * before frames are dropped, CPU per camera and tail write latency as JSON.
+ *
+ *****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include "mantis/MantisAPI.h"
+#include "FrameRecorder.h"
+#include "SessionFiles.h"
+#include "CRC32C.h"
+
+struct BenchConfig {
+    std::string dir;
+    std::string replayDir;
+    std::string output;
+    std::vector<int> cameras;
+    std::vector<int> bitrates;      // Mbit/s per camera
+    std::vector<int> scales;
+    std::vector<int> threads;
+    std::vector<int> queues;
+    double fps;
+    int gop;
+    double duration;
+    int searchSteps;
+    bool checksums;
+    bool frameIndex;
+    bool pool;
+    std::string tapPrefix;
+};
+
+struct ProbeResult {
+    double fps;                     // target frame rate per camera
+    bool sustained;
+    double wallSeconds;
+    double framesPerSecond;         // written frames/s over all cameras
+    double megaBytesPerSecond;      // written MB/s over all cameras
+    double cpuPerCamera;            // percent of one core
+    uint64_t received;
+    uint64_t dropped;
+    uint64_t behind;                // frames the source could not deliver on time
+    size_t maxQueueDepth;
+    LatencyHistogram latency;
+    PoolStats pool;
+};
+
+/**
+ * @brief frames handed to the recorder, shared by all source threads
+ */
+struct FrameSource {
+    std::vector<uint8_t> data;
+    std::vector<FRAME_METADATA> frames;
+    std::vector<size_t> offsets;
+};
+
+static std::vector<int> parseList(const char* str) {
+    std::vector<int> list;
+    const char* p = str;
+    while (*p) {
+        list.push_back(atoi(p));
+        const char* comma = strchr(p, ',');
+        if (comma == NULL)
+            break;
+        p = comma + 1;
+    }
+    return list;
+}
+
+static double cpuSeconds() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1e-6 +
+        usage.ru_stime.tv_sec + usage.ru_stime.tv_usec * 1e-6;
+}
+
+/**
+ * @brief synthetic annex-b frames, one GOP of an I frame followed by P frames
+ *        with the average size matching the requested bitrate
+ */
+static void makeSyntheticSource(FrameSource& source, int bitrate, double fps, int gop) {
+    const double iRatio = 8.0;
+    double avgSize = bitrate * 1e6 / 8.0 / fps;
+    size_t pSize = (size_t)(avgSize * gop / (iRatio + gop - 1));
+    size_t iSize = (size_t)(pSize * iRatio);
+    if (pSize < 16)
+        pSize = 16;
+    source.data.resize(iSize + pSize);
+    srand(12345);
+    for (size_t i = 0; i < source.data.size(); i ++)
+        source.data[i] = (uint8_t)(rand() & 0xff);
+    const uint8_t idr[] = { 0, 0, 0, 1, 0x67, 0x64 };
+    const uint8_t nonIdr[] = { 0, 0, 0, 1, 0x41 };
+    memcpy(&source.data[0], idr, sizeof(idr));
+    memcpy(&source.data[iSize], nonIdr, sizeof(nonIdr));
+
+    source.frames.clear();
+    source.offsets.clear();
+    for (int i = 0; i < gop; i ++) {
+        FRAME_METADATA meta;
+        memset(&meta, 0, sizeof(meta));
+        meta.m_size = i == 0 ? iSize : pSize;
+        meta.m_width = 3864;
+        meta.m_height = 2174;
+        meta.m_framerate = fps;
+        source.frames.push_back(meta);
+        source.offsets.push_back(i == 0 ? 0 : iSize);
+    }
+}
+
+/**
+ * @brief load up to maxBytes of the first camera found in a recorded session
+ */
+static int makeReplaySource(FrameSource& source, const std::string& dir, size_t maxBytes) {
+    std::vector<uint32_t> ids = listCameras(dir);
+    if (ids.empty()) {
+        printf("No recorded camera in %s!\n", dir.c_str());
+        return -1;
+    }
+    uint32_t id = ids[0];
+    std::string metafile = metaFileName(dir, id);
+    std::string h264file = streamFileName(dir, id);
+    FILE* fpmeta = fopen(metafile.c_str(), "rb");
+    FILE* fph264 = fopen(h264file.c_str(), "rb");
+    if (fpmeta == NULL || fph264 == NULL) {
+        printf("Open replay files of camera %u failed!\n", id);
+        if (fpmeta) fclose(fpmeta);
+        if (fph264) fclose(fph264);
+        return -1;
+    }
+    FRAME_METADATA meta;
+    while (fread(&meta, 1, sizeof(meta), fpmeta) == sizeof(meta)) {
+        if (source.data.size() + meta.m_size > maxBytes)
+            break;
+        size_t offset = source.data.size();
+        source.data.resize(offset + meta.m_size);
+        if (fread(&source.data[offset], 1, meta.m_size, fph264) != meta.m_size) {
+            source.data.resize(offset);
+            break;
+        }
+        meta.m_tile = 0;
+        source.frames.push_back(meta);
+        source.offsets.push_back(offset);
+    }
+    fclose(fpmeta);
+    fclose(fph264);
+    fprintf(stderr, "Replay %lu frames (%lu bytes) of camera %u\n", source.frames.size(),
+        source.data.size(), id);
+    return source.frames.empty() ? -1 : 0;
+}
+
+/**
+ * @brief one receiver-like thread per camera delivering frames at a fixed rate
+ */
+static void sourceLoop(FrameRecorder* recorder, const FrameSource* source, uint32_t camId,
+    double fps, int scales, double duration, std::atomic<uint64_t>* behind) {
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    std::chrono::duration<double> period(1.0 / fps);
+    uint64_t total = (uint64_t)(duration * fps);
+    uint64_t late = 0;
+    for (uint64_t i = 0; i < total; i ++) {
+        std::chrono::steady_clock::time_point due = begin +
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(period * (double)i);
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (now < due)
+            std::this_thread::sleep_until(due);
+        else if (now - due > period)
+            late++;
+
+        size_t ind = i % source->frames.size();
+        FRAME frame;
+        frame.m_metadata = source->frames[ind];
+        frame.m_metadata.m_camId = camId;
+        frame.m_metadata.m_id = i;
+        frame.m_metadata.m_timestamp = (uint64_t)(i * 1e6 / fps);
+        frame.m_image = &source->data[source->offsets[ind]];
+        for (int s = 0; s < scales; s ++) {
+            // lower scales are delivered by the receiver as well and filtered by the recorder
+            frame.m_metadata.m_tile = s;
+            if (s > 0)
+                frame.m_metadata.m_size = std::max<size_t>(source->frames[ind].m_size >> (2 * s), 16);
+            recorder->pushFrame(frame);
+        }
+    }
+    *behind += late;
+}
+
+static void removeRecording(const std::string& dir, int numCameras) {
+    for (int c = 0; c < numCameras; c ++) {
+        unlink(streamFileName(dir, 7001 + c).c_str());
+        unlink(metaFileName(dir, 7001 + c).c_str());
+        unlink(checksumFileName(dir, 7001 + c).c_str());
+        unlink(indexFileName(dir, 7001 + c).c_str());
+    }
+}
+
+static ProbeResult runProbe(const BenchConfig& bench, const FrameSource& source, int numCameras,
+    int scales, int threads, int queue, double fps) {
+    RecorderConfig config;
+    config.dir = bench.dir;
+    config.writerThreads = threads;
+    config.queueFrames = queue;
+    config.checksums = bench.checksums;
+    config.frameIndex = bench.frameIndex;
+    config.tapPrefix = bench.tapPrefix;
+    config.verbose = false;
+    if (bench.pool) {
+        // size the pools for the average frame of the source
+        uint64_t sourceBytes = 0;
+        for (size_t i = 0; i < source.frames.size(); i ++)
+            sourceBytes += source.frames[i].m_size;
+        config.expectedFps = fps;
+        config.expectedBitrate = (uint64_t)(sourceBytes * 8.0 / source.frames.size() * fps);
+    }
+
+    ProbeResult result;
+    result.fps = fps;
+    FrameRecorder* recorder = new FrameRecorder(config);
+    for (int c = 0; c < numCameras; c ++)
+        recorder->addCamera(7001 + c);
+
+    std::atomic<uint64_t> behind(0);
+    double cpuBegin = cpuSeconds();
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    recorder->start();
+    std::vector<std::thread> sources;
+    for (int c = 0; c < numCameras; c ++)
+        sources.push_back(std::thread(sourceLoop, recorder, &source, 7001 + c, fps, scales,
+            bench.duration, &behind));
+    for (size_t c = 0; c < sources.size(); c ++)
+        sources[c].join();
+    std::vector<CameraStats> stats = recorder->cameraStats();
+    recorder->stop();
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    double cpu = cpuSeconds() - cpuBegin;
+
+    result.wallSeconds = std::chrono::duration<double>(end - begin).count();
+    result.received = 0;
+    result.dropped = 0;
+    result.maxQueueDepth = 0;
+    uint64_t written = 0;
+    uint64_t bytes = 0;
+    std::vector<CameraStats> finalStats = recorder->cameraStats();
+    for (size_t c = 0; c < stats.size(); c ++) {
+        result.received += finalStats[c].received;
+        result.dropped += finalStats[c].dropped;
+        written += finalStats[c].written;
+        bytes += finalStats[c].bytes;
+        result.maxQueueDepth = std::max(result.maxQueueDepth, stats[c].queueDepth);
+    }
+    result.behind = behind;
+    result.latency = recorder->writeLatency();
+    result.pool = recorder->poolStats();
+    result.framesPerSecond = written / result.wallSeconds;
+    result.megaBytesPerSecond = bytes / result.wallSeconds / 1e6;
+    result.cpuPerCamera = cpu / result.wallSeconds / numCameras * 100.0;
+    // a rate is sustained when nothing was dropped, the source kept its schedule
+    // and the writers were not still building up a backlog when the source stopped
+    uint64_t expected = (uint64_t)(bench.duration * fps) * numCameras;
+    result.sustained = result.dropped == 0 && result.behind * 100 <= expected &&
+        result.maxQueueDepth * 2 <= (size_t)queue;
+    delete recorder;
+    removeRecording(bench.dir, numCameras);
+    return result;
+}
+
+static void writeProbe(FILE* fp, const char* name, const ProbeResult& r) {
+    fprintf(fp, "        \"%s\": {\"target_fps_per_camera\": %.2f, \"sustained\": %s, "
+        "\"frames_per_second\": %.2f, \"mb_per_second\": %.3f, \"cpu_per_camera_percent\": %.3f, "
+        "\"received\": %llu, \"dropped\": %llu, \"source_behind\": %llu, \"max_queue_depth\": %lu, "
+        "\"write_latency_us\": {\"p50\": %llu, \"p99\": %llu, \"p999\": %llu, \"max\": %llu}, "
+        "\"pool\": {\"arena_mb\": %.1f, \"huge_pages\": %s, \"allocations\": %llu, \"spills\": %llu, "
+        "\"misses\": %llu, \"peak_in_use\": %lu}}",
+        name, r.fps, r.sustained ? "true" : "false", r.framesPerSecond, r.megaBytesPerSecond,
+        r.cpuPerCamera, (unsigned long long)r.received, (unsigned long long)r.dropped,
+        (unsigned long long)r.behind, r.maxQueueDepth,
+        (unsigned long long)r.latency.percentile(0.5), (unsigned long long)r.latency.percentile(0.99),
+        (unsigned long long)r.latency.percentile(0.999), (unsigned long long)r.latency.max(),
+        r.pool.arenaBytes / 1e6, r.pool.hugePages ? "true" : "false",
+        (unsigned long long)r.pool.allocations, (unsigned long long)r.pool.spills,
+        (unsigned long long)r.pool.misses, r.pool.peakInUse);
+}
+
+void printHelp() {
+    printf("Sustained-throughput benchmark of the recording pipeline\n");
+    printf("Usage: RecordBenchmark [options]\n");
+    printf("\t--dir <path>       scratch directory for recorded files (default /tmp/record_bench)\n");
+    printf("\t--cameras <list>   camera counts to sweep (default 1,19)\n");
+    printf("\t--bitrates <list>  bitrate per camera in Mbit/s (default 20)\n");
+    printf("\t--scales <list>    scales delivered per frame (default 1,2)\n");
+    printf("\t--threads <list>   writer threads (default 1,4)\n");
+    printf("\t--queue <list>     queue capacity per camera in frames (default 64)\n");
+    printf("\t--fps <n>          nominal frame rate (default 30)\n");
+    printf("\t--gop <n>          I frame interval of synthetic frames (default 30)\n");
+    printf("\t--duration <s>     seconds per probe (default 2)\n");
+    printf("\t--steps <n>        bisection steps of the max rate search (default 4)\n");
+    printf("\t--crc <0|1>        write crc32c checksums (default 1)\n");
+    printf("\t--index <0|1>      write frame indexes (default 1)\n");
+    printf("\t--pool <0|1>       copy frames into the huge page buffer pool (default 1)\n");
+    printf("\t--tap <prefix>     publish frames to shared memory taps (default off)\n");
+    printf("\t--replay <dir>     replay frames of a recorded session instead of synthetic ones\n");
+    printf("\t--output <file>    JSON output file (default stdout)\n");
+}
+
+int main(int argc, char* argv[]) {
+    BenchConfig bench;
+    bench.dir = "/tmp/record_bench";
+    bench.cameras = parseList("1,19");
+    bench.bitrates = parseList("20");
+    bench.scales = parseList("1,2");
+    bench.threads = parseList("1,4");
+    bench.queues = parseList("64");
+    bench.fps = 30;
+    bench.gop = 30;
+    bench.duration = 2;
+    bench.searchSteps = 4;
+    bench.checksums = true;
+    bench.frameIndex = true;
+    bench.pool = true;
+    for (int i = 1; i < argc; i ++) {
+        std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help") {
+            printHelp();
+            return 0;
+        }
+        if (i + 1 >= argc) {
+            printf("Missing value of %s\n", argv[i]);
+            printHelp();
+            return -1;
+        }
+        const char* value = argv[++i];
+        if (arg == "--dir") bench.dir = value;
+        else if (arg == "--cameras") bench.cameras = parseList(value);
+        else if (arg == "--bitrates") bench.bitrates = parseList(value);
+        else if (arg == "--scales") bench.scales = parseList(value);
+        else if (arg == "--threads") bench.threads = parseList(value);
+        else if (arg == "--queue") bench.queues = parseList(value);
+        else if (arg == "--fps") bench.fps = atof(value);
+        else if (arg == "--gop") bench.gop = atoi(value);
+        else if (arg == "--duration") bench.duration = atof(value);
+        else if (arg == "--steps") bench.searchSteps = atoi(value);
+        else if (arg == "--crc") bench.checksums = atoi(value) != 0;
+        else if (arg == "--index") bench.frameIndex = atoi(value) != 0;
+        else if (arg == "--pool") bench.pool = atoi(value) != 0;
+        else if (arg == "--tap") bench.tapPrefix = value;
+        else if (arg == "--replay") bench.replayDir = value;
+        else if (arg == "--output") bench.output = value;
+        else {
+            printf("Unknown option %s\n", argv[i - 1]);
+            printHelp();
+            return -1;
+        }
+    }
+    mkdir(bench.dir.c_str(), 0755);
+
+    FrameSource replay;
+    if (!bench.replayDir.empty()) {
+        if (makeReplaySource(replay, bench.replayDir, (size_t)512 << 20) != 0)
+            return -1;
+        bench.bitrates = std::vector<int>(1, 0);
+    }
+
+    FILE* fp = bench.output.empty() ? stdout : fopen(bench.output.c_str(), "w");
+    if (fp == NULL) {
+        printf("Open output file %s failed!\n", bench.output.c_str());
+        return -1;
+    }
+    char hostname[256] = {0};
+    gethostname(hostname, sizeof(hostname) - 1);
+    fprintf(fp, "{\n  \"host\": \"%s\",\n  \"cpus\": %ld,\n  \"timestamp\": %ld,\n", hostname,
+        sysconf(_SC_NPROCESSORS_ONLN), (long)time(NULL));
+    fprintf(fp, "  \"source\": \"%s\",\n  \"nominal_fps\": %.2f,\n  \"probe_seconds\": %.2f,\n",
+        bench.replayDir.empty() ? "synthetic" : bench.replayDir.c_str(), bench.fps, bench.duration);
+    fprintf(fp, "  \"crc32c\": \"%s\",\n", bench.checksums ? crc32cImplementation() : "off");
+    fprintf(fp, "  \"frame_index\": %s,\n", bench.frameIndex ? "true" : "false");
+    fprintf(fp, "  \"tap\": \"%s\",\n", bench.tapPrefix.empty() ? "off" : bench.tapPrefix.c_str());
+    fprintf(fp, "  \"results\": [");
+
+    bool first = true;
+    for (size_t b = 0; b < bench.bitrates.size(); b ++) {
+        FrameSource synthetic;
+        if (bench.replayDir.empty())
+            makeSyntheticSource(synthetic, bench.bitrates[b], bench.fps, bench.gop);
+        const FrameSource& source = bench.replayDir.empty() ? synthetic : replay;
+    for (size_t c = 0; c < bench.cameras.size(); c ++)
+    for (size_t s = 0; s < bench.scales.size(); s ++)
+    for (size_t t = 0; t < bench.threads.size(); t ++)
+    for (size_t q = 0; q < bench.queues.size(); q ++) {
+        int numCameras = bench.cameras[c];
+        fprintf(stderr, "cameras %d, bitrate %d Mbit/s, scales %d, writer threads %d, queue %d\n",
+            numCameras, bench.bitrates[b], bench.scales[s], bench.threads[t], bench.queues[q]);
+        ProbeResult nominal = runProbe(bench, source, numCameras, bench.scales[s],
+            bench.threads[t], bench.queues[q], bench.fps);
+
+        // double the rate until frames are dropped, then bisect
+        ProbeResult best = nominal;
+        double low = nominal.sustained ? bench.fps : 0;
+        double high = bench.fps;
+        if (nominal.sustained) {
+            for (int k = 0; k < 10; k ++) {
+                ProbeResult r = runProbe(bench, source, numCameras, bench.scales[s],
+                    bench.threads[t], bench.queues[q], low * 2);
+                high = low * 2;
+                if (!r.sustained)
+                    break;
+                best = r;
+                low = high;
+            }
+        }
+        for (int k = 0; k < bench.searchSteps && low > 0 && high > low; k ++) {
+            double mid = (low + high) / 2;
+            ProbeResult r = runProbe(bench, source, numCameras, bench.scales[s],
+                bench.threads[t], bench.queues[q], mid);
+            if (r.sustained) {
+                best = r;
+                low = mid;
+            }
+            else high = mid;
+        }
+
+        fprintf(fp, "%s\n    {\n", first ? "" : ",");
+        first = false;
+        fprintf(fp, "      \"cameras\": %d, \"bitrate_mbps\": %d, \"scales\": %d, "
+            "\"writer_threads\": %d, \"queue_frames\": %d,\n", numCameras, bench.bitrates[b],
+            bench.scales[s], bench.threads[t], bench.queues[q]);
+        fprintf(fp, "      \"max_sustained_fps_per_camera\": %.2f,\n", nominal.sustained ? best.fps : 0.0);
+        fprintf(fp, "      \"probes\": {\n");
+        writeProbe(fp, "nominal", nominal);
+        fprintf(fp, ",\n");
+        writeProbe(fp, "max_sustained", best);
+        fprintf(fp, "\n      }\n    }");
+        fflush(fp);
+    }
+    }
+    fprintf(fp, "\n  ]\n}\n");
+    if (fp != stdout)
+        fclose(fp);
+    return 0;
+}
@@ -0,0 +1,321 @@
+/******************************************************************************
+ *
+ * ReportGaps.cpp
+ *
+ * Report dropped frames and timestamp gaps of a recorded session from the
+ * metadata sidecars. Every interval of a camera that is off its frame period
+ * by more than the tolerance is flagged, late ones are converted to missing
+ * frames, duplicate and backward timestamps are counted. Then the frames of
+ * all cameras are laid on the frame grid of the reference camera, on the
+ * clock drift corrected timestamps as in FindSyncFrames, and every slot that
+ * does not make a full synchronized group is blamed on the cameras that
+ * were not recording yet or any more, dropped their frame, or delivered it
+ * outside the tolerance.
+ *
+ *****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "SessionFiles.h"
+#include "TimeStamps.h"
+#include "ClockDrift.h"
+
+enum LossCause {
+    LOSS_NOT_RECORDING,
+    LOSS_DROPPED,
+    LOSS_OFF_TOLERANCE,
+    LOSS_CAUSES
+};
+
+static const char* causeNames[LOSS_CAUSES] = { "not recording", "dropped frame", "out of tolerance" };
+
+struct Gap {
+    size_t frame;           // frame after the interval
+    uint64_t timeStamp;
+    int64_t interval;
+    uint64_t missing;
+};
+
+struct CameraGaps {
+    uint32_t mcamId;
+    size_t frames;
+    double period;
+    uint64_t expected;      // frames of the period between the first and the last frame
+    uint64_t missing;
+    uint64_t gaps;          // intervals with missing frames
+    uint64_t late;          // intervals beyond the tolerance without a missing frame
+    uint64_t early;
+    uint64_t duplicates;
+    uint64_t backwards;
+    int64_t longest;
+    std::vector<Gap> listed;
+    uint64_t lost[LOSS_CAUSES]; // groups this camera was missing from
+};
+
+void findGaps(const uint64_t* stream, size_t frames, double period, uint64_t eps, size_t limit, CameraGaps& report) {
+    report.frames = frames;
+    report.period = period;
+    report.expected = frames > 1 && period > 0 ? (uint64_t)((stream[frames - 1] - stream[0]) / period + 1.5) : frames;
+    report.missing = report.gaps = report.late = report.early = 0;
+    report.duplicates = report.backwards = 0;
+    report.longest = 0;
+    report.listed.clear();
+    for (int c = 0; c < LOSS_CAUSES; c ++)
+        report.lost[c] = 0;
+    for (size_t k = 1; k < frames; k ++) {
+        int64_t interval = (int64_t)(stream[k] - stream[k - 1]);
+        uint64_t missing = 0;
+        if (interval == 0)
+            report.duplicates++;
+        else if (interval < 0)
+            report.backwards++;
+        else if (interval > period + eps) {
+            missing = (uint64_t)std::max(0.0, floor(interval / period + 0.5) - 1);
+            if (missing > 0) {
+                report.gaps++;
+                report.missing += missing;
+            }
+            else report.late++;
+        }
+        else if (interval + (double)eps < period)
+            report.early++;
+        else continue;
+        report.longest = std::max(report.longest, interval);
+        if (report.listed.size() < limit) {
+            Gap gap = { k, stream[k], interval, missing };
+            report.listed.push_back(gap);
+        }
+    }
+}
+
+/**
+ * @brief slots of the reference camera: its frames and, inside its gaps and
+ *        before and after it within the span of all cameras, the frames it missed
+ */
+void referenceSlots(const TimeStampTable& timeStamps, int reference, std::vector<uint64_t>& slots,
+    std::vector<bool>& recorded) {
+    const uint64_t* stream = timeStamps.stream(reference);
+    size_t frames = timeStamps.size(reference);
+    double period = timeStamps.periods[reference];
+    uint64_t first = UINT64_MAX, last = 0;
+    for (int i = 0; i < timeStamps.cameras(); i ++) {
+        if (timeStamps.size(i) == 0)
+            continue;
+        first = std::min(first, timeStamps.stream(i)[0]);
+        last = std::max(last, timeStamps.stream(i)[timeStamps.size(i) - 1]);
+    }
+    slots.clear();
+    recorded.clear();
+    if (frames == 0 || period <= 0)
+        return;
+    for (double t = stream[0] - period; t > first - period / 2 && t > 0; t -= period) {
+        slots.push_back((uint64_t)t);
+        recorded.push_back(false);
+    }
+    std::reverse(slots.begin(), slots.end());
+    for (size_t k = 0; k < frames; k ++) {
+        if (k > 0 && stream[k] > stream[k - 1]) {
+            double interval = (double)(stream[k] - stream[k - 1]);
+            int parts = (int)floor(interval / period + 0.5);
+            for (int p = 1; p < parts; p ++) {
+                slots.push_back(stream[k - 1] + (uint64_t)(interval * p / parts));
+                recorded.push_back(false);
+            }
+        }
+        slots.push_back(stream[k]);
+        recorded.push_back(true);
+    }
+    for (double t = stream[frames - 1] + period; t < last + period / 2; t += period) {
+        slots.push_back((uint64_t)t);
+        recorded.push_back(false);
+    }
+}
+
+/**
+ * @brief blame every slot without a full group on the cameras missing from it,
+ *        or on the camera furthest from the reference if the group spreads beyond eps
+ * @param lostBy slots lost by their first cause, not recording before dropped before out of tolerance
+ */
+uint64_t findLostGroups(const TimeStampTable& timeStamps, int reference, uint64_t eps,
+    std::vector<CameraGaps>& reports, uint64_t& slotCount, uint64_t lostBy[LOSS_CAUSES]) {
+    std::vector<uint64_t> slots;
+    std::vector<bool> recorded;
+    referenceSlots(timeStamps, reference, slots, recorded);
+    slotCount = slots.size();
+    for (int c = 0; c < LOSS_CAUSES; c ++)
+        lostBy[c] = 0;
+    int numStreams = timeStamps.cameras();
+    const uint64_t* referenceStream = timeStamps.stream(reference);
+    uint64_t referenceFirst = referenceStream[0];
+    uint64_t referenceLast = referenceStream[timeStamps.size(reference) - 1];
+    std::vector<size_t> pos(numStreams, 0);
+    std::vector<uint64_t> candidate(numStreams, 0);
+    uint64_t lost = 0;
+    for (size_t s = 0; s < slots.size(); s ++) {
+        uint64_t t = slots[s];
+        int slotCause = LOSS_CAUSES;
+        candidate[reference] = t;
+        for (int i = 0; i < numStreams; i ++) {
+            int cause = LOSS_CAUSES;
+            if (i == reference) {
+                if (!recorded[s])
+                    cause = t < referenceFirst || t > referenceLast ? LOSS_NOT_RECORDING : LOSS_DROPPED;
+            }
+            else {
+                const uint64_t* stream = timeStamps.stream(i);
+                size_t frames = timeStamps.size(i);
+                if (frames == 0 || t + eps < stream[0] || t > stream[frames - 1] + eps)
+                    cause = LOSS_NOT_RECORDING;
+                else {
+                    while (pos[i] + 1 < frames && stream[pos[i] + 1] <= t)
+                        pos[i]++;
+                    size_t next = std::min(pos[i] + 1, frames - 1);
+                    uint64_t before = stream[pos[i]] <= t ? t - stream[pos[i]] : stream[pos[i]] - t;
+                    uint64_t after = stream[next] >= t ? stream[next] - t : t - stream[next];
+                    if (std::min(before, after) > eps)
+                        cause = (double)(stream[next] - stream[pos[i]]) > timeStamps.periods[i] + eps ?
+                            LOSS_DROPPED : LOSS_OFF_TOLERANCE;
+                    else candidate[i] = before <= after ? stream[pos[i]] : stream[next];
+                }
+            }
+            if (cause == LOSS_CAUSES)
+                continue;
+            reports[i].lost[cause]++;
+            slotCause = std::min(slotCause, cause);
+        }
+        if (slotCause == LOSS_CAUSES) {
+            // as in FindSyncFrames all frames of a group lie within eps of each other
+            uint64_t first = t, last = t;
+            int furthest = reference;
+            for (int i = 0; i < numStreams; i ++) {
+                if (i == reference)
+                    continue;
+                first = std::min(first, candidate[i]);
+                last = std::max(last, candidate[i]);
+                uint64_t distance = candidate[i] > t ? candidate[i] - t : t - candidate[i];
+                uint64_t furthestDistance = candidate[furthest] > t ? candidate[furthest] - t : t - candidate[furthest];
+                if (distance > furthestDistance)
+                    furthest = i;
+            }
+            if (last - first > eps) {
+                reports[furthest].lost[LOSS_OFF_TOLERANCE]++;
+                slotCause = LOSS_OFF_TOLERANCE;
+            }
+        }
+        if (slotCause != LOSS_CAUSES) {
+            lost++;
+            lostBy[slotCause]++;
+        }
+    }
+    return lost;
+}
+
+void printHelp() {
+    printf("Report dropped frames, timestamp gaps and lost synchronized groups of a session\n");
+    printf("Usage: ReportGaps <session dir> [-t tolerance] [-w window] [-r mcam id] [-l gaps] [-j threads] [mcam id ...]\n");
+    printf("\t-t tolerance largest timestamp deviation in us (default: half the shortest frame period)\n");
+    printf("\t-w window    seconds of every clock drift fit, 0 uses the recorded time stamps (default 60)\n");
+    printf("\t-r mcam id   reference camera of the group grid (default: first of the slowest cameras)\n");
+    printf("\t-l gaps      flagged intervals listed per camera (default 10)\n");
+    printf("\t-j threads   cameras loaded and fitted in parallel (default: number of cores)\n");
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2 || strcmp(argv[1], "-h") == 0) {
+        printHelp();
+        return argc < 2 ? -1 : 0;
+    }
+    std::string dir = argv[1];
+    uint64_t eps = 0;
+    uint64_t window = 60;
+    uint32_t referenceId = 0;
+    size_t limit = 10;
+    int threads = 0;
+    std::vector<uint32_t> ids;
+    for (int i = 2; i < argc; i ++) {
+        if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+            eps = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc)
+            window = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+            referenceId = (uint32_t)strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc)
+            limit = (size_t)atoi(argv[++i]);
+        else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else ids.push_back(atoi(argv[i]));
+    }
+    if (ids.empty())
+        ids = listCameras(dir);
+    if (ids.empty()) {
+        printf("No recorded camera in %s!\n", dir.c_str());
+        return -1;
+    }
+    TimeStampTable timeStamps;
+    if (loadTimeStamps(dir, ids, threads, timeStamps) != 0)
+        return -1;
+    int reference = slowestCamera(timeStamps);
+    if (referenceId != 0) {
+        reference = (int)(std::find(ids.begin(), ids.end(), referenceId) - ids.begin());
+        if (reference == (int)ids.size()) {
+            printf("No recorded camera %u in %s!\n", referenceId, dir.c_str());
+            return -1;
+        }
+    }
+    if (eps == 0)
+        eps = defaultTolerance(timeStamps);
+
+    std::vector<CameraGaps> reports(ids.size());
+    for (size_t i = 0; i < ids.size(); i ++) {
+        reports[i].mcamId = ids[i];
+        findGaps(timeStamps.stream((int)i), timeStamps.size((int)i), timeStamps.periods[i], eps, limit, reports[i]);
+    }
+    printf("Camera   Frames  Expected  Period(ms)  Missing  Gaps  Late  Early  Dup  Back  Longest(ms)\n");
+    for (size_t i = 0; i < reports.size(); i ++) {
+        const CameraGaps& r = reports[i];
+        printf("%-6u %8lu %9lu %11.3f %8lu %5lu %5lu %6lu %4lu %5lu %12.3f\n", r.mcamId, r.frames, r.expected,
+            r.period / 1e3, r.missing, r.gaps, r.late, r.early, r.duplicates, r.backwards, r.longest / 1e3);
+    }
+    for (size_t i = 0; i < reports.size(); i ++) {
+        const CameraGaps& r = reports[i];
+        if (r.listed.empty())
+            continue;
+        printf("Flagged intervals of camera %u:\n", r.mcamId);
+        for (size_t k = 0; k < r.listed.size(); k ++) {
+            const Gap& gap = r.listed[k];
+            printf("\tframe %lu at %llu us: %lld us", gap.frame, (unsigned long long)gap.timeStamp,
+                (long long)gap.interval);
+            if (gap.missing > 0)
+                printf(", %llu missing", (unsigned long long)gap.missing);
+            printf("\n");
+        }
+    }
+
+    const TimeStampTable* matched = &timeStamps;
+    TimeStampTable corrected;
+    std::vector<ClockFit> fits;
+    if (window > 0) {
+        correctClocks(timeStamps, reference, window * 1000000, eps, threads, fits, corrected);
+        matched = &corrected;
+    }
+    uint64_t slots = 0;
+    uint64_t lostBy[LOSS_CAUSES];
+    uint64_t lost = timeStamps.size(reference) > 0 ?
+        findLostGroups(*matched, reference, eps, reports, slots, lostBy) : 0;
+    printf("Synchronized groups on the grid of camera %u: %lu slots, %lu complete, %lu lost\n", ids[reference],
+        slots, slots - lost, lost);
+    for (int c = 0; c < LOSS_CAUSES && lost > 0; c ++)
+        printf("\t%lu lost, first cause %s\n", lostBy[c], causeNames[c]);
+    if (lost > 0) {
+        printf("Camera   %s  %s  %s\n", causeNames[LOSS_NOT_RECORDING], causeNames[LOSS_DROPPED],
+            causeNames[LOSS_OFF_TOLERANCE]);
+        for (size_t i = 0; i < reports.size(); i ++)
+            printf("%-6u %15lu %15lu %18lu\n", reports[i].mcamId, reports[i].lost[LOSS_NOT_RECORDING],
+                reports[i].lost[LOSS_DROPPED], reports[i].lost[LOSS_OFF_TOLERANCE]);
+    }
+    return 0;
+}
@@ -0,0 +1,74 @@
+#include "SessionFiles.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <algorithm>
+
+const char* propertyName(int property) {
+    switch (property) {
+    case PROPERTY_EXPOSURE: return "exposure";
+    case PROPERTY_GAIN: return "gain";
+    case PROPERTY_SHUTTER: return "shutter";
+    case PROPERTY_WHITE_BALANCE: return "white_balance";
+    case PROPERTY_FOCUS: return "focus";
+    default: return "unknown";
+    }
+}
+
+std::string streamFileName(const std::string& dir, uint32_t mcamId) {
+    char name[256];
+    sprintf(name, "%s/mcam_%u", dir.c_str(), mcamId);
+    return name;
+}
+
+std::string metaFileName(const std::string& dir, uint32_t mcamId) {
+    char name[256];
+    sprintf(name, "%s/mcam_config_%u", dir.c_str(), mcamId);
+    return name;
+}
+
+std::string checksumFileName(const std::string& dir, uint32_t mcamId) {
+    char name[256];
+    sprintf(name, "%s/mcam_crc_%u", dir.c_str(), mcamId);
+    return name;
+}
+
+std::string indexFileName(const std::string& dir, uint32_t mcamId) {
+    char name[256];
+    sprintf(name, "%s/mcam_idx_%u", dir.c_str(), mcamId);
+    return name;
+}
+
+std::string rateControlFileName(const std::string& dir, uint32_t mcamId) {
+    char name[256];
+    sprintf(name, "%s/mcam_ratectl_%u", dir.c_str(), mcamId);
+    return name;
+}
+
+std::string propertyLogFileName(const std::string& dir) {
+    return dir + "/property_log";
+}
+
+std::vector<uint32_t> listCameras(const std::string& dir) {
+    std::vector<uint32_t> ids;
+    DIR* d = opendir(dir.c_str());
+    if (d == NULL)
+        return ids;
+    struct dirent* entry;
+    while ((entry = readdir(d)) != NULL) {
+        if (strncmp(entry->d_name, "mcam_config_", 12) != 0)
+            continue;
+        const char* id = entry->d_name + 12;
+        char* end;
+        unsigned long value = strtoul(id, &end, 10);
+        // skip derived files such as mcam_config_7001.txt
+        if (end == id || *end != '\0')
+            continue;
+        ids.push_back((uint32_t)value);
+    }
+    closedir(d);
+    std::sort(ids.begin(), ids.end());
+    return ids;
+}
@@ -0,0 +1,67 @@
+/**
+ * @file SessionFiles.h
+ * @brief names and on-disk records of the files of a recorded session
+ *
+ * A session directory holds, for every mcam <id>:
+ *   mcam_<id>          the raw h264 stream, frames back to back
+ *   mcam_config_<id>   one FRAME_METADATA record per frame
+ *   mcam_crc_<id>      one FrameChecksum record per frame
+ *   mcam_idx_<id>      FrameIndexEntry per frame after a FrameIndexHeader (FrameIndex.h)
+ *   mcam_ratectl_<id>  text log of encoder changes made by the bitrate controller
+ * and once per session:
+ *   property_log       PropertyRecord for every change of a logged mcam property
+ */
+#ifndef __SESSION_FILES_H__
+#define __SESSION_FILES_H__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/**
+ * @brief per frame record of mcam_crc_<id>, parallel to the records of mcam_config_<id>
+ */
+struct FrameChecksum {
+    uint32_t data;      //!< crc32c of the frame bytes in mcam_<id>
+    uint32_t meta;      //!< crc32c of the FRAME_METADATA record in mcam_config_<id>
+};
+
+/**
+ * @brief properties recorded in property_log
+ */
+enum PropertyId {
+    PROPERTY_EXPOSURE = 0,
+    PROPERTY_GAIN = 1,
+    PROPERTY_SHUTTER = 2,
+    PROPERTY_WHITE_BALANCE = 3,     //!< value holds red, green and blue
+    PROPERTY_FOCUS = 4,
+    NUM_PROPERTIES
+};
+
+/**
+ * @brief record of property_log, written when a property changes and once at start
+ */
+struct PropertyRecord {
+    uint64_t time;          //!< host wall clock in microseconds
+    uint64_t timestamp;     //!< timestamp of the last frame received from the mcam, 0 if none yet
+    uint32_t mcamId;
+    uint16_t property;      //!< PropertyId
+    uint16_t initial;       //!< 1 for the values read when logging starts
+    double value[3];
+};
+
+const char* propertyName(int property);
+
+std::string streamFileName(const std::string& dir, uint32_t mcamId);
+std::string metaFileName(const std::string& dir, uint32_t mcamId);
+std::string checksumFileName(const std::string& dir, uint32_t mcamId);
+std::string indexFileName(const std::string& dir, uint32_t mcamId);
+std::string rateControlFileName(const std::string& dir, uint32_t mcamId);
+std::string propertyLogFileName(const std::string& dir);
+
+/**
+ * @brief ids of all cameras that have a mcam_config_<id> sidecar in dir, sorted
+ */
+std::vector<uint32_t> listCameras(const std::string& dir);
+
+#endif // __SESSION_FILES_H__
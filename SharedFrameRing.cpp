@@ -0,0 +1,196 @@
+#include "SharedFrameRing.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static size_t alignUp(size_t size, size_t align) {
+    return (size + align - 1) / align * align;
+}
+
+static size_t slotsOffset() {
+    return alignUp(sizeof(TapHeader), 64);
+}
+
+static size_t dataOffset(uint32_t slotCount) {
+    return alignUp(slotsOffset() + sizeof(TapSlot) * slotCount, 4096);
+}
+
+std::string tapName(const std::string& prefix, uint32_t mcamId) {
+    char name[256];
+    sprintf(name, "/%s_%u", prefix.c_str(), mcamId);
+    return name;
+}
+
+/*************************************************************
+* SharedFrameWriter
+*************************************************************/
+SharedFrameWriter::SharedFrameWriter() : base(NULL), mapSize(0), header(NULL), slots(NULL), data(NULL) {}
+
+SharedFrameWriter::~SharedFrameWriter() {
+    close();
+}
+
+int SharedFrameWriter::create(const std::string& prefix, uint32_t mcamId, uint32_t slotCount,
+    uint64_t dataSize) {
+    close();
+    name = tapName(prefix, mcamId);
+    shm_unlink(name.c_str());
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) {
+        printf("Create shared memory %s failed!\n", name.c_str());
+        return -1;
+    }
+    dataSize = alignUp(dataSize, 4096);
+    mapSize = dataOffset(slotCount) + dataSize;
+    if (ftruncate(fd, mapSize) != 0) {
+        printf("Resize shared memory %s to %lu bytes failed!\n", name.c_str(), mapSize);
+        ::close(fd);
+        shm_unlink(name.c_str());
+        return -1;
+    }
+    base = mmap(NULL, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED) {
+        printf("Map shared memory %s failed!\n", name.c_str());
+        base = NULL;
+        shm_unlink(name.c_str());
+        return -1;
+    }
+    header = (TapHeader*)base;
+    slots = (TapSlot*)((uint8_t*)base + slotsOffset());
+    data = (uint8_t*)base + dataOffset(slotCount);
+    header->mcamId = mcamId;
+    header->slotCount = slotCount;
+    header->dataSize = dataSize;
+    header->writeSeq.store(0, std::memory_order_relaxed);
+    header->writePos.store(0, std::memory_order_relaxed);
+    for (uint32_t i = 0; i < slotCount; i ++)
+        slots[i].seq.store(0, std::memory_order_relaxed);
+    header->version = TAP_VERSION;
+    std::atomic_thread_fence(std::memory_order_release);
+    header->magic = TAP_MAGIC;
+    return 0;
+}
+
+bool SharedFrameWriter::publish(const FRAME_METADATA& meta, const uint8_t* image) {
+    if (header == NULL || meta.m_size > header->dataSize / 2)
+        return false;
+    uint64_t n = header->writeSeq.load(std::memory_order_relaxed);
+    uint64_t pos = header->writePos.load(std::memory_order_relaxed);
+    uint64_t offset = pos % header->dataSize;
+    // frames are never split, skip the tail of the ring if the frame does not fit
+    if (offset + meta.m_size > header->dataSize) {
+        pos += header->dataSize - offset;
+        offset = 0;
+    }
+    TapSlot& slot = slots[n % header->slotCount];
+    slot.seq.store(2 * n + 1, std::memory_order_relaxed);
+    // reserve the bytes before overwriting them so readers of older frames notice
+    header->writePos.store(pos + meta.m_size, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(data + offset, image, meta.m_size);
+    slot.dataPos = pos;
+    slot.meta = meta;
+    slot.seq.store(2 * n + 2, std::memory_order_release);
+    header->writeSeq.store(n + 1, std::memory_order_release);
+    return true;
+}
+
+void SharedFrameWriter::close() {
+    if (base == NULL)
+        return;
+    munmap(base, mapSize);
+    shm_unlink(name.c_str());
+    base = NULL;
+    header = NULL;
+    slots = NULL;
+    data = NULL;
+}
+
+/*************************************************************
+* SharedFrameReader
+*************************************************************/
+SharedFrameReader::SharedFrameReader() : base(NULL), mapSize(0), header(NULL), slots(NULL), data(NULL) {}
+
+SharedFrameReader::~SharedFrameReader() {
+    detach();
+}
+
+int SharedFrameReader::attach(const std::string& prefix, uint32_t mcamId) {
+    detach();
+    std::string name = tapName(prefix, mcamId);
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        printf("Open shared memory %s failed!\n", name.c_str());
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(TapHeader)) {
+        printf("Shared memory %s is not initialized!\n", name.c_str());
+        ::close(fd);
+        return -1;
+    }
+    mapSize = st.st_size;
+    base = mmap(NULL, mapSize, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED) {
+        printf("Map shared memory %s failed!\n", name.c_str());
+        base = NULL;
+        return -1;
+    }
+    header = (const TapHeader*)base;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (header->magic != TAP_MAGIC || header->version != TAP_VERSION ||
+        dataOffset(header->slotCount) + header->dataSize > mapSize) {
+        printf("Shared memory %s has an unknown layout!\n", name.c_str());
+        detach();
+        return -1;
+    }
+    slots = (const TapSlot*)((const uint8_t*)base + slotsOffset());
+    data = (const uint8_t*)base + dataOffset(header->slotCount);
+    return 0;
+}
+
+void SharedFrameReader::detach() {
+    if (base == NULL)
+        return;
+    munmap(base, mapSize);
+    base = NULL;
+    header = NULL;
+    slots = NULL;
+    data = NULL;
+}
+
+uint64_t SharedFrameReader::published() const {
+    return header->writeSeq.load(std::memory_order_acquire);
+}
+
+uint64_t SharedFrameReader::oldest() const {
+    uint64_t n = published();
+    return n > header->slotCount ? n - header->slotCount : 0;
+}
+
+bool SharedFrameReader::acquire(uint64_t seq, TapFrame& frame) const {
+    const TapSlot& slot = slots[seq % header->slotCount];
+    uint64_t s1 = slot.seq.load(std::memory_order_acquire);
+    if (s1 != 2 * seq + 2)
+        return false;
+    frame.seq = seq;
+    frame.dataPos = slot.dataPos;
+    frame.meta = slot.meta;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.seq.load(std::memory_order_relaxed) != s1)
+        return false;
+    frame.image = data + frame.dataPos % header->dataSize;
+    return valid(frame);
+}
+
+bool SharedFrameReader::valid(const TapFrame& frame) const {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t pos = header->writePos.load(std::memory_order_relaxed);
+    return pos - frame.dataPos <= header->dataSize;
+}
@@ -0,0 +1,107 @@
+/**
+ * @file SharedFrameRing.h
+ * @brief per camera shared memory ring that publishes every received frame
+ *        with its FRAME_METADATA to other local processes
+ *
+ * The recorder is the single writer of each ring and never waits for
+ * readers: a frame is copied once into the ring and published by bumping
+ * sequence numbers. Readers attach read-only, look at frames in place and
+ * validate afterwards that the writer has not overwritten them (seqlock).
+ * A slow reader therefore loses frames but never slows down the recording.
+ *
+ * Layout of the shared memory object /<prefix>_<mcamId>:
+ *   TapHeader | TapSlot[slotCount] | data ring of dataSize bytes
+ */
+#ifndef __SHARED_FRAME_RING_H__
+#define __SHARED_FRAME_RING_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <atomic>
+#include "mantis/MantisAPI.h"
+
+#define TAP_MAGIC 0x5441504d    // "MPAT"
+#define TAP_VERSION 1
+
+struct TapHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t mcamId;
+    uint32_t slotCount;
+    uint64_t dataSize;
+    std::atomic<uint64_t> writeSeq;     //!< number of frames published
+    std::atomic<uint64_t> writePos;     //!< bytes reserved in the data ring, monotonic
+};
+
+struct TapSlot {
+    std::atomic<uint64_t> seq;          //!< 2n+1 while frame n is written, 2n+2 once published
+    uint64_t dataPos;                   //!< monotonic position of the frame bytes in the data ring
+    FRAME_METADATA meta;
+};
+
+/**
+ * @brief a frame seen by a reader, image points into the shared memory
+ */
+struct TapFrame {
+    uint64_t seq;
+    uint64_t dataPos;
+    FRAME_METADATA meta;
+    const uint8_t* image;
+};
+
+std::string tapName(const std::string& prefix, uint32_t mcamId);
+
+/**
+ * @brief writer side, owned by the recorder
+ */
+class SharedFrameWriter {
+public:
+    SharedFrameWriter();
+    ~SharedFrameWriter();
+    /** @brief create (or replace) the shared memory object of a camera */
+    int create(const std::string& prefix, uint32_t mcamId, uint32_t slotCount, uint64_t dataSize);
+    /** @brief publish one frame, frames larger than half the data ring are skipped */
+    bool publish(const FRAME_METADATA& meta, const uint8_t* image);
+    void close();
+
+private:
+    std::string name;
+    void* base;
+    size_t mapSize;
+    TapHeader* header;
+    TapSlot* slots;
+    uint8_t* data;
+};
+
+/**
+ * @brief reader side, any number of processes may attach to the same ring
+ */
+class SharedFrameReader {
+public:
+    SharedFrameReader();
+    ~SharedFrameReader();
+    int attach(const std::string& prefix, uint32_t mcamId);
+    void detach();
+
+    /** @brief sequence number of the next frame to be published */
+    uint64_t published() const;
+    /** @brief oldest sequence number that may still be in the ring */
+    uint64_t oldest() const;
+    /**
+     * @brief look at frame seq in place
+     * @return false if the frame is not published yet or already overwritten
+     */
+    bool acquire(uint64_t seq, TapFrame& frame) const;
+    /** @brief true if the bytes of an acquired frame were not overwritten meanwhile */
+    bool valid(const TapFrame& frame) const;
+
+private:
+    void* base;
+    size_t mapSize;
+    const TapHeader* header;
+    const TapSlot* slots;
+    const uint8_t* data;
+};
+
+#endif // __SHARED_FRAME_RING_H__
@@ -0,0 +1,196 @@
+/******************************************************************************
+ *
+ * SyncBenchmark.cpp
+ *
+ * Benchmark of the nearest frame search of the synchronizer. The timestamps
+ * of a recorded session, or of a synthetic one with jitter and dropped
+ * frames, are synced to the frames of the first camera for every tolerance
+ * with the scalar and the vectorized NearestFrames. Both must find the same
+ * frames; the best and median time of a pass, ns per target time and per
+ * camera lookup and the groups found are printed.
+ *
+ *****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <chrono>
+#include "SessionFiles.h"
+#include "TimeStamps.h"
+#include "NearestFrames.h"
+
+struct SyncBenchConfig {
+    std::string session;
+    int cameras;
+    double minutes;
+    double fps;
+    std::vector<int> tolerances;    // us
+    int repeat;
+};
+
+static std::vector<int> parseList(const char* value) {
+    std::vector<int> list;
+    for (const char* p = value; *p; ) {
+        list.push_back(atoi(p));
+        p = strchr(p, ',');
+        if (p == NULL)
+            break;
+        p++;
+    }
+    return list;
+}
+
+/**
+ * @brief timestamps of cameras at fps with +-300 us jitter, an offset of 50 us
+ *        per camera, 1% dropped frames and start frames of 0 to 5
+ */
+void syntheticTimeStamps(int cameras, double minutes, double fps, TimeStampTable& table) {
+    std::mt19937 random(1);
+    std::uniform_int_distribution<int> jitter(-300, 300);
+    std::uniform_int_distribution<int> start(0, 5);
+    std::uniform_real_distribution<double> drop(0, 1);
+    size_t frames = (size_t)(minutes * 60 * fps);
+    table.ids.clear();
+    table.data.clear();
+    table.offsets.assign(1, 0);
+    for (int c = 0; c < cameras; c ++) {
+        table.ids.push_back(7001 + c);
+        for (size_t f = start(random); f < frames; f ++) {
+            if (drop(random) < 0.01)
+                continue;
+            table.data.push_back((uint64_t)(1000000 + f * 1e6 / fps + jitter(random) + c * 50));
+        }
+        table.offsets.push_back(table.data.size());
+    }
+    table.framerates.assign(cameras, fps);
+    table.periods.assign(cameras, 1e6 / fps);
+}
+
+/** @return groups of all cameras within eps of the frames of camera 0 */
+size_t syncPass(NearestFrames& search, const TimeStampTable& table, uint64_t eps,
+    std::vector<int>& frames, std::vector<uint64_t>& distances) {
+    search.reset();
+    size_t groups = 0;
+    int cameras = table.cameras();
+    const uint64_t* master = table.stream(0);
+    for (size_t m = 0; m < table.size(0); m ++) {
+        search.find(master[m], &frames[0], &distances[0]);
+        bool complete = true;
+        for (int i = 1; i < cameras; i ++)
+            complete &= distances[i] <= eps;
+        groups += complete;
+    }
+    return groups;
+}
+
+/** @return targets whose nearest frames differ between the two searches */
+size_t compareSearches(NearestFrames& a, NearestFrames& b, const TimeStampTable& table) {
+    int cameras = table.cameras();
+    std::vector<int> framesA(cameras), framesB(cameras);
+    std::vector<uint64_t> distancesA(cameras), distancesB(cameras);
+    a.reset();
+    b.reset();
+    size_t mismatches = 0;
+    const uint64_t* master = table.stream(0);
+    for (size_t m = 0; m < table.size(0); m ++) {
+        a.find(master[m], &framesA[0], &distancesA[0]);
+        b.find(master[m], &framesB[0], &distancesB[0]);
+        mismatches += framesA != framesB || distancesA != distancesB;
+    }
+    return mismatches;
+}
+
+void printHelp() {
+    printf("Benchmark the nearest frame search of the synchronizer\n");
+    printf("Usage: SyncBenchmark [options]\n");
+    printf("\t--session <dir>     sync the timestamps of a recorded session instead of synthetic ones\n");
+    printf("\t--cameras <n>       synthetic cameras (default 19)\n");
+    printf("\t--minutes <n>       synthetic recording length (default 10)\n");
+    printf("\t--fps <n>           synthetic frame rate (default 30)\n");
+    printf("\t--tolerances <list> tolerances to sync with in us (default 2000,8000,16666)\n");
+    printf("\t--repeat <n>        passes per tolerance and implementation (default 5)\n");
+}
+
+int main(int argc, char* argv[]) {
+    SyncBenchConfig bench;
+    bench.cameras = 19;
+    bench.minutes = 10;
+    bench.fps = 30;
+    bench.tolerances = parseList("2000,8000,16666");
+    bench.repeat = 5;
+    for (int i = 1; i < argc; i ++) {
+        std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help") {
+            printHelp();
+            return 0;
+        }
+        if (i + 1 >= argc) {
+            printf("Missing value of %s\n", argv[i]);
+            printHelp();
+            return -1;
+        }
+        const char* value = argv[++i];
+        if (arg == "--session") bench.session = value;
+        else if (arg == "--cameras") bench.cameras = atoi(value);
+        else if (arg == "--minutes") bench.minutes = atof(value);
+        else if (arg == "--fps") bench.fps = atof(value);
+        else if (arg == "--tolerances") bench.tolerances = parseList(value);
+        else if (arg == "--repeat") bench.repeat = std::max(1, atoi(value));
+        else {
+            printf("Unknown option %s\n", argv[i - 1]);
+            printHelp();
+            return -1;
+        }
+    }
+
+    TimeStampTable table;
+    if (!bench.session.empty()) {
+        std::vector<uint32_t> ids = listCameras(bench.session);
+        if (ids.empty()) {
+            printf("No recorded camera in %s!\n", bench.session.c_str());
+            return -1;
+        }
+        if (loadTimeStamps(bench.session, ids, 0, table) != 0)
+            return -1;
+    }
+    else syntheticTimeStamps(bench.cameras, bench.minutes, bench.fps, table);
+    int cameras = table.cameras();
+    size_t targets = table.size(0);
+    if (targets == 0) {
+        printf("Camera %u has no frames!\n", table.ids[0]);
+        return -1;
+    }
+
+    NearestFrames scalar(table, false);
+    NearestFrames vectorized(table, true);
+    size_t mismatches = compareSearches(scalar, vectorized, table);
+    printf("%d cameras, %lu frames, %lu targets, %s against scalar: %lu mismatches\n", cameras, table.data.size(),
+        targets, vectorized.implementation(), mismatches);
+    if (mismatches > 0)
+        return -1;
+
+    std::vector<int> frames(cameras);
+    std::vector<uint64_t> distances(cameras);
+    printf("Tolerance(us)  Implementation  Groups  Best(ms)  Median(ms)  ns/target  ns/lookup\n");
+    for (size_t t = 0; t < bench.tolerances.size(); t ++) {
+        NearestFrames* searches[2] = { &scalar, &vectorized };
+        for (int s = 0; s < 2; s ++) {
+            std::vector<double> times;
+            size_t groups = 0;
+            for (int r = 0; r < bench.repeat; r ++) {
+                std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+                groups = syncPass(*searches[s], table, bench.tolerances[t], frames, distances);
+                times.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count());
+            }
+            std::sort(times.begin(), times.end());
+            double best = times[0];
+            printf("%13d  %14s  %6lu  %8.3f  %10.3f  %9.1f  %9.2f\n", bench.tolerances[t],
+                searches[s]->implementation(), groups, best * 1e3, times[times.size() / 2] * 1e3,
+                best * 1e9 / targets, best * 1e9 / targets / cameras);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,137 @@
+#include "SyncIndex.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+// the ids are padded so the entries stay 8 byte aligned
+static size_t idsSize(uint32_t cameras) {
+    return (cameras * sizeof(uint32_t) + 7) & ~(size_t)7;
+}
+
+SyncIndex::SyncIndex() : ids(NULL), entries(NULL), count(0), numCameras(0), map(NULL), mapSize(0) {
+}
+
+SyncIndex::~SyncIndex() {
+    close();
+}
+
+int SyncIndex::open(const std::string& file) {
+    close();
+    int fd = ::open(file.c_str(), O_RDONLY);
+    if (fd < 0) {
+        printf("Open sync index %s failed!\n", file.c_str());
+        return -1;
+    }
+    struct stat st;
+    SyncIndexHeader header;
+    if (fstat(fd, &st) != 0 || pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+        memcmp(header.magic, SYNC_INDEX_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != SYNC_INDEX_VERSION || header.entrySize != sizeof(SyncIndexEntry) ||
+        header.cameras == 0 || (uint64_t)st.st_size < sizeof(header) + idsSize(header.cameras) +
+        header.groups * header.cameras * sizeof(SyncIndexEntry)) {
+        printf("%s is not a sync index!\n", file.c_str());
+        ::close(fd);
+        return -1;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        printf("Map sync index %s failed!\n", file.c_str());
+        map = NULL;
+        return -1;
+    }
+    mapSize = st.st_size;
+    numCameras = (int)header.cameras;
+    count = header.groups;
+    ids = (const uint32_t*)((const char*)map + sizeof(header));
+    entries = (const SyncIndexEntry*)((const char*)ids + idsSize(header.cameras));
+    return 0;
+}
+
+void SyncIndex::close() {
+    if (map)
+        munmap(map, mapSize);
+    map = NULL;
+    mapSize = 0;
+    ids = NULL;
+    entries = NULL;
+    count = 0;
+    numCameras = 0;
+}
+
+int SyncIndex::camera(uint32_t mcamId) const {
+    for (int i = 0; i < numCameras; i ++)
+        if (ids[i] == mcamId)
+            return i;
+    return numCameras;
+}
+
+size_t SyncIndex::groupAt(uint64_t timestamp) const {
+    if (count == 0)
+        return count;
+    // the frames of every camera grow with the group
+    size_t low = 0, high = count;
+    while (low < high) {
+        size_t mid = (low + high) / 2;
+        if (group(mid)->timestamp < timestamp)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    if (low == count || (low > 0 && timestamp - group(low - 1)->timestamp < group(low)->timestamp - timestamp))
+        return low - 1;
+    return low;
+}
+
+int SyncIndex::save(const std::string& file, const std::vector<uint32_t>& ids,
+    const std::vector<SyncIndexEntry>& entries) {
+    if (ids.empty() || entries.size() % ids.size() != 0)
+        return -1;
+    std::string tmpfile = file + ".tmp";
+    FILE* fp = fopen(tmpfile.c_str(), "wb");
+    if (fp == NULL) {
+        printf("Open sync index %s failed!\n", tmpfile.c_str());
+        return -1;
+    }
+    SyncIndexHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SYNC_INDEX_MAGIC, sizeof(header.magic));
+    header.version = SYNC_INDEX_VERSION;
+    header.entrySize = sizeof(SyncIndexEntry);
+    header.cameras = (uint32_t)ids.size();
+    header.groups = entries.size() / ids.size();
+    fwrite(&header, 1, sizeof(header), fp);
+    std::vector<uint8_t> padded(idsSize(header.cameras), 0);
+    memcpy(&padded[0], &ids[0], ids.size() * sizeof(uint32_t));
+    fwrite(&padded[0], 1, padded.size(), fp);
+    if (!entries.empty())
+        fwrite(&entries[0], sizeof(SyncIndexEntry), entries.size(), fp);
+    int ret = ferror(fp) ? -1 : 0;
+    if (fclose(fp) != 0 || ret != 0 || rename(tmpfile.c_str(), file.c_str()) != 0) {
+        printf("Write sync index %s failed!\n", file.c_str());
+        unlink(tmpfile.c_str());
+        return -1;
+    }
+    return 0;
+}
+
+int SyncIndex::exportText(const std::string& file) const {
+    FILE* fp = fopen(file.c_str(), "w");
+    if (fp == NULL) {
+        printf("Open sync file %s failed!\n", file.c_str());
+        return -1;
+    }
+    for (size_t i = 0; i < count; i ++) {
+        fprintf(fp, "%lu\t", i);
+        const SyncIndexEntry* entry = group(i);
+        for (int j = 0; j < numCameras; j ++)
+            fprintf(fp, "%u\t%llu\t", entry[j].frame, (unsigned long long)entry[j].timestamp);
+        fprintf(fp, "\n");
+    }
+    fclose(fp);
+    return 0;
+}
@@ -0,0 +1,74 @@
+/**
+ * @file SyncIndex.h
+ * @brief synchronized frame groups of a session with the byte offset of every frame
+ *
+ * The file written by FindSyncFrames is a SyncIndexHeader, the mcam ids of
+ * the cameras (padded to 8 bytes) and one SyncIndexEntry per camera for
+ * every group, group after group. It is mapped on open, so a group is found
+ * by number in O(1) and by timestamp with a binary search, and its frames
+ * can be read from the streams directly at their offsets.
+ */
+#ifndef __SYNC_INDEX_H__
+#define __SYNC_INDEX_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#define SYNC_INDEX_MAGIC "MCAMSYN"
+#define SYNC_INDEX_VERSION 1
+// offset of a frame that is not in its stream, e.g. of a truncated recording
+#define SYNC_NO_OFFSET UINT64_MAX
+
+struct SyncIndexHeader {
+    char magic[8];          //!< SYNC_INDEX_MAGIC
+    uint32_t version;       //!< SYNC_INDEX_VERSION
+    uint32_t entrySize;     //!< sizeof(SyncIndexEntry)
+    uint32_t cameras;       //!< entries per group
+    uint32_t reserved;
+    uint64_t groups;
+};
+
+struct SyncIndexEntry {
+    uint64_t offset;        //!< byte offset of the frame in mcam_<id>, SYNC_NO_OFFSET if unknown
+    uint64_t timestamp;     //!< timestamp of the frame in us
+    uint32_t frame;         //!< number of the frame in the stream and its sidecar
+    uint32_t size;          //!< m_size of the frame
+};
+
+class SyncIndex {
+public:
+    SyncIndex();
+    ~SyncIndex();
+
+    int open(const std::string& file);
+    void close();
+
+    /** @brief number of groups */
+    size_t size() const { return count; }
+    int cameras() const { return numCameras; }
+    uint32_t mcamId(int camera) const { return ids[camera]; }
+    /** @brief camera of an mcam id, cameras() if it is not in the index */
+    int camera(uint32_t mcamId) const;
+    /** @brief cameras() entries of group i in the order of the cameras */
+    const SyncIndexEntry* group(size_t i) const { return entries + i * numCameras; }
+    /** @brief group whose frame of the first camera is nearest to timestamp, size() if there is none */
+    size_t groupAt(uint64_t timestamp) const;
+
+    /** @brief write groups * ids.size() entries to file */
+    static int save(const std::string& file, const std::vector<uint32_t>& ids,
+        const std::vector<SyncIndexEntry>& entries);
+    /** @brief write the groups as the tab separated text table of FindSyncFrames */
+    int exportText(const std::string& file) const;
+
+private:
+    const uint32_t* ids;
+    const SyncIndexEntry* entries;
+    size_t count;
+    int numCameras;
+    void* map;
+    size_t mapSize;
+};
+
+#endif // __SYNC_INDEX_H__
@@ -0,0 +1,150 @@
+/******************************************************************************
+ *
+ * TapMonitor.cpp
+ *
+ * Attach to the shared memory frame rings published by RecordStream and
+ * print per camera frame rate, bandwidth and frames missed by this reader
+ * once per second. Optionally saves the live h264 stream of one camera,
+ * e.g. "TapMonitor mantis_tap 7001 -o /dev/stdout | ffplay -". With -s the
+ * frames of all cameras are grouped live and the synchronized group rate
+ * and skew are printed as well.
+ *
+ *****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include "mantis/MantisAPI.h"
+#include "SharedFrameRing.h"
+#include "FrameSynchronizer.h"
+
+struct TapCamera {
+    uint32_t mcamId;
+    SharedFrameReader reader;
+    uint64_t next;
+    uint64_t frames;
+    uint64_t bytes;
+    uint64_t missed;
+    uint64_t lastTimestamp;
+};
+
+void printHelp() {
+    printf("Monitor shared memory frame taps of RecordStream\n");
+    printf("Usage: TapMonitor <tap prefix> <mcam id> [mcam id ...] [-o <file>] [-s <tolerance>]\n");
+    printf("\t-o <file>      save the frames of the first camera to file\n");
+    printf("\t-s <tolerance> group the frames of all cameras within tolerance us\n");
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3 || strcmp(argv[1], "-h") == 0) {
+        printHelp();
+        return argc < 3 ? -1 : 0;
+    }
+    std::string prefix = argv[1];
+    std::vector<uint32_t> ids;
+    FILE* fpout = NULL;
+    uint64_t tolerance = 0;
+    for (int i = 2; i < argc; i ++) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            fpout = fopen(argv[++i], "wb");
+            if (fpout == NULL) {
+                printf("Open output file %s failed!\n", argv[i]);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+            tolerance = strtoull(argv[++i], NULL, 10);
+        else ids.push_back(atoi(argv[i]));
+    }
+    // the status goes to stderr when frames are written to stdout
+    FILE* log = fpout ? stderr : stdout;
+
+    std::vector<TapCamera*> cameras;
+    for (size_t i = 0; i < ids.size(); i ++) {
+        TapCamera* cam = new TapCamera;
+        if (cam->reader.attach(prefix, ids[i]) != 0) {
+            delete cam;
+            return -1;
+        }
+        cam->mcamId = ids[i];
+        cam->next = cam->reader.published();
+        cam->frames = 0;
+        cam->bytes = 0;
+        cam->missed = 0;
+        cam->lastTimestamp = 0;
+        cameras.push_back(cam);
+    }
+
+    uint64_t groups = 0;
+    uint64_t skew = 0;
+    FrameSynchronizer* sync = NULL;
+    if (tolerance > 0)
+        sync = new FrameSynchronizer(ids, tolerance, [&](const std::vector<SyncFrame>& group) {
+            uint64_t first = group[0].timeStamp, last = group[0].timeStamp;
+            for (size_t i = 1; i < group.size(); i ++) {
+                first = std::min(first, group[i].timeStamp);
+                last = std::max(last, group[i].timeStamp);
+            }
+            skew = std::max(skew, last - first);
+            groups++;
+        });
+
+    std::chrono::steady_clock::time_point report = std::chrono::steady_clock::now();
+    for (;;) {
+        bool idle = true;
+        for (size_t i = 0; i < cameras.size(); i ++) {
+            TapCamera* cam = cameras[i];
+            uint64_t published = cam->reader.published();
+            if (cam->next < cam->reader.oldest()) {
+                cam->missed += cam->reader.oldest() - cam->next;
+                cam->next = cam->reader.oldest();
+            }
+            for (; cam->next < published; cam->next ++) {
+                TapFrame frame;
+                if (!cam->reader.acquire(cam->next, frame)) {
+                    cam->missed++;
+                    continue;
+                }
+                idle = false;
+                if (fpout && i == 0) {
+                    fwrite(frame.image, 1, frame.meta.m_size, fpout);
+                    // the bytes may have been overwritten while writing them out
+                    if (!cam->reader.valid(frame))
+                        fprintf(log, "Frame %llu of camera %u was overwritten while saving\n",
+                            (unsigned long long)frame.seq, cam->mcamId);
+                }
+                cam->frames++;
+                cam->bytes += frame.meta.m_size;
+                cam->lastTimestamp = frame.meta.m_timestamp;
+                if (sync)
+                    sync->onFrame(cam->mcamId, frame.meta.m_timestamp, frame.seq);
+            }
+        }
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(now - report).count();
+        if (seconds >= 1.0) {
+            for (size_t i = 0; i < cameras.size(); i ++) {
+                TapCamera* cam = cameras[i];
+                fprintf(log, "Camera %u: %.1f fps, %.2f MB/s, missed %llu, timestamp %llu\n", cam->mcamId,
+                    cam->frames / seconds, cam->bytes / seconds / 1e6, (unsigned long long)cam->missed,
+                    (unsigned long long)cam->lastTimestamp);
+                cam->frames = 0;
+                cam->bytes = 0;
+            }
+            if (sync) {
+                fprintf(log, "Synchronized: %.1f groups/s, skew %llu us, discarded %llu\n", groups / seconds,
+                    (unsigned long long)skew, (unsigned long long)sync->discarded());
+                groups = 0;
+                skew = 0;
+            }
+            report = now;
+        }
+        if (idle)
+            usleep(2000);
+    }
+    return 0;
+}
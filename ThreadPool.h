@@ -0,0 +1,38 @@
+/**
+ * @file ThreadPool.h
+ * @brief run independent jobs on a bounded number of threads
+ */
+#ifndef __THREAD_POOL_H__
+#define __THREAD_POOL_H__
+
+#include <stddef.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <functional>
+
+/**
+ * @brief call job(i) for every i in [0, count) using at most threads threads,
+ *        jobs are handed out in order as threads become free
+ * @param threads number of threads, <= 0 uses the number of cores
+ */
+inline void parallelFor(size_t count, int threads, const std::function<void(size_t)>& job) {
+    if (threads <= 0)
+        threads = (int)std::thread::hardware_concurrency();
+    if (threads <= 0)
+        threads = 1;
+    if ((size_t)threads > count)
+        threads = (int)count;
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> pool;
+    for (int t = 0; t < threads; t ++) {
+        pool.push_back(std::thread([&]() {
+            for (size_t i = next++; i < count; i = next++)
+                job(i);
+        }));
+    }
+    for (size_t t = 0; t < pool.size(); t ++)
+        pool[t].join();
+}
+
+#endif // __THREAD_POOL_H__
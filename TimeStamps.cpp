@@ -0,0 +1,116 @@
+#include "TimeStamps.h"
+#include "SessionFiles.h"
+#include "ThreadPool.h"
+#include "mantis/MantisAPI.h"
+
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <math.h>
+#include <atomic>
+#include <algorithm>
+
+/**
+ * @brief frame period in us from the framerate and the median interval,
+ *        timestamps counted in ms, 100 ns or ns ticks are scaled to us
+ */
+static double derivePeriod(uint32_t id, double framerate, uint64_t* column, size_t frames) {
+    std::vector<uint64_t> intervals;
+    for (size_t k = 1; k < frames; k ++)
+        if (column[k] > column[k - 1])
+            intervals.push_back(column[k] - column[k - 1]);
+    double median = 0;
+    if (!intervals.empty()) {
+        std::nth_element(intervals.begin(), intervals.begin() + intervals.size() / 2, intervals.end());
+        median = (double)intervals[intervals.size() / 2];
+    }
+    if (framerate <= 0 || median <= 0)
+        return median;
+    // timestamp ticks per second, a camera dropping every other frame is still within a factor 2
+    double ticks = median * framerate;
+    for (double unit = 1e3; unit <= 1e9; unit *= 10) {
+        if (ticks < unit * 0.8 || ticks > unit * 2.2)
+            continue;
+        if (unit != 1e6) {
+            printf("Time stamps of camera %u count %.0f ticks per second, converted to us\n", id, unit);
+            for (size_t k = 0; k < frames; k ++)
+                column[k] = (uint64_t)(column[k] * (1e6 / unit) + 0.5);
+        }
+        return 1e6 / framerate;
+    }
+    printf("Framerate %.3f of camera %u does not match its median interval %.0f, using the interval\n",
+        framerate, id, median);
+    return median;
+}
+
+int loadTimeStamps(const std::string& dir, const std::vector<uint32_t>& ids, int threads, TimeStampTable& table) {
+    table.ids = ids;
+    table.offsets.assign(ids.size() + 1, 0);
+    table.framerates.assign(ids.size(), 0);
+    table.periods.assign(ids.size(), 0);
+    std::vector<int> fds(ids.size(), -1);
+    std::atomic<int> ret(0);
+    for (size_t i = 0; i < ids.size(); i ++) {
+        std::string metafile = metaFileName(dir, ids[i]);
+        fds[i] = open(metafile.c_str(), O_RDONLY);
+        struct stat st;
+        if (fds[i] < 0 || fstat(fds[i], &st) != 0) {
+            printf("Open metadata file %s failed!\n", metafile.c_str());
+            ret = -1;
+            st.st_size = 0;
+        }
+        table.offsets[i + 1] = table.offsets[i] + st.st_size / sizeof(FRAME_METADATA);
+    }
+    table.data.resize(table.offsets[ids.size()]);
+
+    parallelFor(ids.size(), threads, [&](size_t i) {
+        size_t frames = table.size((int)i);
+        if (frames == 0)
+            return;
+        size_t length = frames * sizeof(FRAME_METADATA);
+        void* map = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fds[i], 0);
+        if (map == MAP_FAILED) {
+            printf("Map metadata file of camera %u failed!\n", ids[i]);
+            ret = -1;
+            return;
+        }
+        madvise(map, length, MADV_SEQUENTIAL);
+        const FRAME_METADATA* records = (const FRAME_METADATA*)map;
+        uint64_t* column = &table.data[table.offsets[i]];
+        for (size_t k = 0; k < frames; k ++)
+            column[k] = records[k].m_timestamp;
+        if (isfinite(records[0].m_framerate) && records[0].m_framerate > 0)
+            table.framerates[i] = records[0].m_framerate;
+        munmap(map, length);
+        table.periods[i] = derivePeriod(ids[i], table.framerates[i], column, frames);
+    });
+    for (size_t i = 0; i < fds.size(); i ++)
+        if (fds[i] >= 0)
+            close(fds[i]);
+    return ret.load();
+}
+
+int slowestCamera(const TimeStampTable& table) {
+    int slowest = 0;
+    for (int i = 1; i < table.cameras(); i ++)
+        if (table.periods[i] > table.periods[slowest] * 1.05)
+            slowest = i;
+    return slowest;
+}
+
+bool mixedFrameRates(const TimeStampTable& table) {
+    for (int i = 1; i < table.cameras(); i ++)
+        if (fabs(table.periods[i] - table.periods[0]) > table.periods[0] * 0.05)
+            return true;
+    return false;
+}
+
+uint64_t defaultTolerance(const TimeStampTable& table) {
+    double shortest = 0;
+    for (int i = 0; i < table.cameras(); i ++)
+        if (table.periods[i] > 0 && (shortest == 0 || table.periods[i] < shortest))
+            shortest = table.periods[i];
+    return shortest > 0 ? (uint64_t)(shortest / 2) : 100000 / 6;
+}
@@ -0,0 +1,49 @@
+/**
+ * @file TimeStamps.h
+ * @brief frame timestamps of all cameras of a session, one contiguous column per camera
+ *
+ * Only m_timestamp is taken from the FRAME_METADATA records of the sidecars.
+ * The sidecars are mapped and read in parallel, so loading long sessions is
+ * bound by the disk rather than by one read call per record.
+ *
+ * The frame period of every camera is derived from m_framerate and the
+ * median interval of its timestamps, which also gives the timestamp unit:
+ * streams whose clock does not tick in us are converted to us on load.
+ */
+#ifndef __TIME_STAMPS_H__
+#define __TIME_STAMPS_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+struct TimeStampTable {
+    std::vector<uint32_t> ids;      //!< mcam id of every camera
+    std::vector<uint64_t> data;     //!< timestamps of all cameras back to back
+    std::vector<size_t> offsets;    //!< first timestamp of camera i in data, offsets[N] is data.size()
+    std::vector<double> framerates; //!< m_framerate of every camera, 0 if not recorded
+    std::vector<double> periods;    //!< frame period of every camera in us
+
+    int cameras() const { return (int)ids.size(); }
+    const uint64_t* stream(int i) const { return data.empty() ? NULL : &data[offsets[i]]; }
+    size_t size(int i) const { return offsets[i + 1] - offsets[i]; }
+};
+
+/**
+ * @brief load the timestamps of the cameras ids of a session
+ * @param threads cameras loaded in parallel, <= 0 uses the number of cores
+ */
+int loadTimeStamps(const std::string& dir, const std::vector<uint32_t>& ids, int threads, TimeStampTable& table);
+
+/** @brief first of the cameras with the longest frame period */
+int slowestCamera(const TimeStampTable& table);
+/** @brief true if the frame periods of the cameras differ by more than 5% */
+bool mixedFrameRates(const TimeStampTable& table);
+/**
+ * @brief half the shortest frame period in us, a frame of a faster camera
+ *        never matches the neighbour of its partner
+ */
+uint64_t defaultTolerance(const TimeStampTable& table);
+
+#endif // __TIME_STAMPS_H__
@@ -0,0 +1,258 @@
+#include "Topology.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+// from linux/mempolicy.h, libnuma is not required
+#define MPOL_BIND_POLICY 2
+#define MPOL_F_NODE_FLAG (1 << 0)
+#define MPOL_F_ADDR_FLAG (1 << 1)
+
+bool parseCpuList(const char* str, std::vector<int>& list) {
+    list.clear();
+    const char* p = str;
+    while (*p) {
+        char* end;
+        long first = strtol(p, &end, 10);
+        if (end == p || first < 0)
+            return false;
+        long last = first;
+        p = end;
+        if (*p == '-') {
+            last = strtol(p + 1, &end, 10);
+            if (end == p + 1 || last < first)
+                return false;
+            p = end;
+        }
+        for (long i = first; i <= last; i ++)
+            list.push_back((int)i);
+        if (*p == ',')
+            p ++;
+        else if (*p)
+            return false;
+    }
+    std::sort(list.begin(), list.end());
+    list.erase(std::unique(list.begin(), list.end()), list.end());
+    return !list.empty();
+}
+
+std::string cpuListString(const std::vector<int>& list) {
+    std::string str;
+    char buf[32];
+    for (size_t i = 0; i < list.size(); ) {
+        size_t j = i;
+        while (j + 1 < list.size() && list[j + 1] == list[j] + 1)
+            j ++;
+        if (j > i)
+            sprintf(buf, "%s%d-%d", str.empty() ? "" : ",", list[i], list[j]);
+        else sprintf(buf, "%s%d", str.empty() ? "" : ",", list[i]);
+        str += buf;
+        i = j + 1;
+    }
+    return str;
+}
+
+int loadTopology(const std::string& fileName, TopologyConfig& topology) {
+    std::ifstream in(fileName.c_str());
+    if (!in) {
+        printf("Open topology file %s failed!\n", fileName.c_str());
+        return -1;
+    }
+    topology = TopologyConfig();
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(in, line)) {
+        lineNumber ++;
+        size_t comment = line.find('#');
+        if (comment != std::string::npos)
+            line.erase(comment);
+        std::istringstream words(line);
+        std::string key;
+        if (!(words >> key))
+            continue;
+
+        bool ok = true;
+        std::string value;
+        if (key == "receiver") {
+            ok = (words >> value) && parseCpuList(value.c_str(), topology.receiverCpus);
+        }
+        else if (key == "nic") {
+            ok = (bool)(words >> topology.nic);
+        }
+        else if (key == "writer") {
+            WriterPlacement writer;
+            writer.node = -1;
+            ok = (words >> value) && parseCpuList(value.c_str(), writer.cpus);
+            while (ok && (words >> key)) {
+                if (key == "node")
+                    ok = (bool)(words >> writer.node);
+                else if (key == "cameras") {
+                    std::vector<int> ids;
+                    ok = (words >> value) && parseCpuList(value.c_str(), ids);
+                    writer.cameras.assign(ids.begin(), ids.end());
+                }
+                else ok = false;
+            }
+            if (ok && writer.node < 0)
+                writer.node = nodeOfCpu(writer.cpus[0]);
+            topology.writers.push_back(writer);
+        }
+        else ok = false;
+
+        if (!ok) {
+            printf("Invalid line %d of topology file %s\n", lineNumber, fileName.c_str());
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int nodeOfCpu(int cpu) {
+    char path[64];
+    sprintf(path, "/sys/devices/system/cpu/cpu%d", cpu);
+    DIR* dir = opendir(path);
+    if (dir == NULL)
+        return 0;
+    int node = 0;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, "node", 4) == 0 && entry->d_name[4] >= '0' && entry->d_name[4] <= '9') {
+            node = atoi(entry->d_name + 4);
+            break;
+        }
+    }
+    closedir(dir);
+    return node;
+}
+
+int pinThread(pthread_t thread, const std::vector<int>& cpus) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (cpus.empty()) {
+        long online = sysconf(_SC_NPROCESSORS_CONF);
+        for (long i = 0; i < online && i < CPU_SETSIZE; i ++)
+            CPU_SET(i, &set);
+    }
+    for (size_t i = 0; i < cpus.size(); i ++)
+        if (cpus[i] < CPU_SETSIZE)
+            CPU_SET(cpus[i], &set);
+    int err = pthread_setaffinity_np(thread, sizeof(set), &set);
+    if (err != 0)
+        printf("Pin thread to cpus %s failed: %s\n", cpuListString(cpus).c_str(), strerror(err));
+    return err == 0 ? 0 : -1;
+}
+
+std::vector<int> threadCpus(pthread_t thread) {
+    std::vector<int> cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (pthread_getaffinity_np(thread, sizeof(set), &set) != 0)
+        return cpus;
+    for (int i = 0; i < CPU_SETSIZE; i ++)
+        if (CPU_ISSET(i, &set))
+            cpus.push_back(i);
+    return cpus;
+}
+
+int bindMemory(void* addr, size_t length, int node) {
+    if (node < 0)
+        return 0;
+    unsigned long mask[16];
+    memset(mask, 0, sizeof(mask));
+    if (node >= (int)(sizeof(mask) * 8))
+        return -1;
+    mask[node / (8 * sizeof(unsigned long))] |= 1ul << (node % (8 * sizeof(unsigned long)));
+    if (syscall(SYS_mbind, addr, length, MPOL_BIND_POLICY, mask, sizeof(mask) * 8, 0) != 0) {
+        printf("Bind %lu bytes to numa node %d failed: %s\n", length, node, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+int nodeOfAddress(void* addr) {
+    int node = -1;
+    if (syscall(SYS_get_mempolicy, &node, NULL, 0, addr, MPOL_F_NODE_FLAG | MPOL_F_ADDR_FLAG) != 0)
+        return -1;
+    return node;
+}
+
+static std::string readLine(const std::string& path) {
+    std::ifstream in(path.c_str());
+    std::string line;
+    std::getline(in, line);
+    return line;
+}
+
+void printThreadPlacement(FILE* fp) {
+    DIR* dir = opendir("/proc/self/task");
+    if (dir == NULL)
+        return;
+    std::vector<int> tids;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL)
+        if (entry->d_name[0] >= '0' && entry->d_name[0] <= '9')
+            tids.push_back(atoi(entry->d_name));
+    closedir(dir);
+    std::sort(tids.begin(), tids.end());
+
+    fprintf(fp, "%-8s %-16s %-6s %s\n", "tid", "name", "cpu", "allowed cpus");
+    for (size_t i = 0; i < tids.size(); i ++) {
+        char path[64];
+        sprintf(path, "/proc/self/task/%d/status", tids[i]);
+        std::ifstream status(path);
+        std::string line, name, allowed;
+        while (std::getline(status, line)) {
+            if (line.compare(0, 5, "Name:") == 0)
+                name = line.substr(line.find_first_not_of(" \t", 5));
+            else if (line.compare(0, 18, "Cpus_allowed_list:") == 0)
+                allowed = line.substr(line.find_first_not_of(" \t", 18));
+        }
+        // the last cpu the thread ran on is field 39 of stat, counted after the "(comm)" field
+        sprintf(path, "/proc/self/task/%d/stat", tids[i]);
+        std::string stat = readLine(path);
+        int cpu = -1;
+        size_t paren = stat.rfind(')');
+        if (paren != std::string::npos) {
+            std::istringstream fields(stat.substr(paren + 1));
+            std::string field;
+            for (int k = 3; k <= 39 && (fields >> field); k ++)
+                if (k == 39)
+                    cpu = atoi(field.c_str());
+        }
+        fprintf(fp, "%-8d %-16s %-6d %s (node %d)\n", tids[i], name.c_str(), cpu, allowed.c_str(),
+            cpu >= 0 ? nodeOfCpu(cpu) : -1);
+    }
+}
+
+void printNicPlacement(FILE* fp, const std::string& nic) {
+    std::string device = "/sys/class/net/" + nic + "/device";
+    std::string node = readLine(device + "/numa_node");
+    fprintf(fp, "NIC %s: numa node %s\n", nic.c_str(), node.empty() ? "unknown" : node.c_str());
+    DIR* dir = opendir((device + "/msi_irqs").c_str());
+    if (dir == NULL)
+        return;
+    std::vector<int> irqs;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL)
+        if (entry->d_name[0] >= '0' && entry->d_name[0] <= '9')
+            irqs.push_back(atoi(entry->d_name));
+    closedir(dir);
+    std::sort(irqs.begin(), irqs.end());
+    for (size_t i = 0; i < irqs.size(); i ++) {
+        char path[64];
+        sprintf(path, "/proc/irq/%d/effective_affinity_list", irqs[i]);
+        std::string effective = readLine(path);
+        sprintf(path, "/proc/irq/%d/smp_affinity_list", irqs[i]);
+        std::string allowed = readLine(path);
+        fprintf(fp, "\tirq %d: cpus %s, effective %s\n", irqs[i], allowed.c_str(),
+            effective.empty() ? "unknown" : effective.c_str());
+    }
+}
@@ -0,0 +1,66 @@
+/**
+ * @file Topology.h
+ * @brief CPU and NUMA placement of the recording threads
+ *
+ * A topology file pins the MantisAPI receive threads and every writer thread
+ * of the recorder to a set of cores and places the writer's frame buffer
+ * pool on a NUMA node. One directive per line, '#' starts a comment:
+ *
+ *     # cores the receive threads created by the MantisAPI inherit
+ *     receiver 0-3
+ *     # writer <cpus> [node <n>] [cameras <ids>], one line per writer thread
+ *     writer 4-7 node 0 cameras 7001-7010
+ *     writer 24-27 node 1 cameras 7011-7019
+ *     # report the numa node and interrupt affinity of the network interface
+ *     nic enp65s0f0
+ *
+ * Lists are comma separated numbers and ranges. The node of a writer
+ * defaults to the node of its first cpu, cameras not listed by any writer
+ * are assigned round robin.
+ */
+#ifndef __TOPOLOGY_H__
+#define __TOPOLOGY_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <string>
+#include <vector>
+
+struct WriterPlacement {
+    std::vector<int> cpus;          //!< cores of the writer thread, empty leaves it unpinned
+    int node;                       //!< NUMA node of the buffer pool, -1 for no binding
+    std::vector<uint32_t> cameras;  //!< mcam ids written by this writer
+};
+
+struct TopologyConfig {
+    std::vector<int> receiverCpus;
+    std::vector<WriterPlacement> writers;
+    std::string nic;
+};
+
+/** @brief parse a topology file, returns 0 on success */
+int loadTopology(const std::string& fileName, TopologyConfig& topology);
+
+/** @brief parse "0-3,8,10-11" */
+bool parseCpuList(const char* str, std::vector<int>& list);
+std::string cpuListString(const std::vector<int>& list);
+
+/** @brief NUMA node of a cpu, 0 on machines without NUMA information */
+int nodeOfCpu(int cpu);
+
+/** @brief restrict a thread to the cpus, an empty list allows all online cpus */
+int pinThread(pthread_t thread, const std::vector<int>& cpus);
+std::vector<int> threadCpus(pthread_t thread);
+
+/** @brief bind a not yet faulted mapping to the memory of a NUMA node */
+int bindMemory(void* addr, size_t length, int node);
+/** @brief NUMA node holding the page of addr, -1 if unknown */
+int nodeOfAddress(void* addr);
+
+/** @brief print name, allowed cpus and last cpu of every thread of this process */
+void printThreadPlacement(FILE* fp);
+/** @brief print the NUMA node of a network interface and the affinity of its interrupts */
+void printNicPlacement(FILE* fp, const std::string& nic);
+
+#endif // __TOPOLOGY_H__
@@ -0,0 +1,395 @@
+/******************************************************************************
+ *
+ * ValidateSession.cpp
+ *
+ * Cross-check the metadata sidecars of a recorded session against their
+ * streams. Every stream is read once, front to back, and split into access
+ * units at the NAL units that start a new frame; the size of every sidecar
+ * record is compared with the size of its access unit. Zero size records,
+ * records past the end of the stream, frames the sidecar misses, a stream
+ * that ends inside its last frame and timestamps out of order are reported.
+ * Cameras are validated in parallel.
+ *
+ * With -r the sidecar is rebuilt from the access units: record sizes are
+ * set from the stream, zero size records are dropped, records are added for
+ * frames the sidecar misses and a partial last frame is cut from the
+ * stream. The checksums of changed frames are recomputed, the previous
+ * sidecars are kept as mcam_config_<id>.bak and mcam_crc_<id>.bak.
+ *
+ *****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include "mantis/MantisAPI.h"
+#include "SessionFiles.h"
+#include "NalParser.h"
+#include "ThreadPool.h"
+#include "CRC32C.h"
+
+#define SCAN_CHUNK (8 << 20)
+
+struct AccessUnits {
+    int codec;
+    std::vector<uint64_t> starts;   // offset of every access unit
+    uint64_t streamSize;
+
+    size_t count() const { return starts.size(); }
+    uint64_t size(size_t i) const { return (i + 1 < starts.size() ? starts[i + 1] : streamSize) - starts[i]; }
+};
+
+struct ValidateResult {
+    uint32_t mcamId;
+    std::string error;              // set when the camera could not be validated
+    int codec;
+    uint64_t records;
+    uint64_t units;                 // access units in the stream
+    uint64_t zeroSize;              // records of zero bytes
+    uint64_t mismatched;            // records whose size differs from their access unit
+    uint64_t extraRecords;          // records past the end of the stream
+    uint64_t missingRecords;        // access units without a record
+    uint64_t timestampErrors;       // timestamps not after the one before
+    bool truncated;                 // the stream ends inside the last frame of the sidecar
+    std::vector<uint64_t> badFrames;
+    bool repaired;
+    uint64_t repairedRecords;
+    uint64_t cutBytes;              // bytes of a partial last frame cut from the stream
+
+    bool ok() const {
+        return zeroSize == 0 && mismatched == 0 && extraRecords == 0 && missingRecords == 0 &&
+            timestampErrors == 0 && !truncated;
+    }
+};
+
+static const size_t kMaxReportedFrames = 10;
+
+/**
+ * @brief find the access units of a stream in one sequential pass
+ */
+static int scanAccessUnits(int fd, AccessUnits& units) {
+    units.codec = CODEC_UNKNOWN;
+    units.starts.clear();
+    units.streamSize = 0;
+    std::vector<uint8_t> buffer(SCAN_CHUNK + 8);
+    uint64_t base = 0;                  // stream offset of buffer[0]
+    size_t have = 0;
+    size_t pos = 0;
+    bool eof = false;
+    bool sliceSeen = false;
+    while (!eof) {
+        // keep the byte in front of pos to tell 4 byte start codes
+        size_t keep = pos > 0 ? pos - 1 : 0;
+        memmove(&buffer[0], &buffer[keep], have - keep);
+        base += keep;
+        have -= keep;
+        pos -= keep;
+        ssize_t n = read(fd, &buffer[have], SCAN_CHUNK);
+        if (n < 0)
+            return -1;
+        if (n == 0)
+            eof = true;
+        have += n;
+        const uint8_t* data = &buffer[0];
+        const uint8_t* end = data + have;
+        if (units.codec == CODEC_UNKNOWN && have > 0) {
+            units.codec = detectCodec(data, std::min<size_t>(have, 1 << 20));
+            units.starts.push_back(0);
+        }
+        for (;;) {
+            const uint8_t* sc = findStartCode(data + pos, end);
+            if (!eof && sc + 6 > end) {
+                // the NAL header is in the next chunk, a start code may span the chunks
+                if (sc < end)
+                    pos = sc - data;
+                else if (have > pos + 5)
+                    pos = have - 5;
+                break;
+            }
+            if (sc >= end) {
+                pos = have;
+                break;
+            }
+            uint8_t header[3] = { 0, 0, 0 };
+            memcpy(header, sc + 3, std::min<size_t>(3, end - sc - 3));
+            if (startsAccessUnit(header, units.codec, sliceSeen)) {
+                uint64_t offset = base + (sc - data);
+                if (sc > data && sc[-1] == 0)
+                    offset--;
+                units.starts.push_back(offset);
+            }
+            pos = sc + 3 - data;
+        }
+    }
+    units.streamSize = base + have;
+    return 0;
+}
+
+static void readRecords(const std::string& file, void* record, size_t recordSize, std::vector<uint8_t>& records) {
+    records.clear();
+    FILE* fp = fopen(file.c_str(), "rb");
+    if (fp == NULL)
+        return;
+    while (fread(record, 1, recordSize, fp) == recordSize)
+        records.insert(records.end(), (uint8_t*)record, (uint8_t*)record + recordSize);
+    fclose(fp);
+}
+
+/**
+ * @brief write records to file.tmp, keep file as file.bak and rename file.tmp to file
+ */
+static int replaceFile(const std::string& file, const void* data, size_t size) {
+    std::string tmpfile = file + ".tmp";
+    FILE* fp = fopen(tmpfile.c_str(), "wb");
+    if (fp == NULL)
+        return -1;
+    if (size > 0)
+        fwrite(data, 1, size, fp);
+    int ret = ferror(fp) ? -1 : 0;
+    if (fclose(fp) != 0 || ret != 0) {
+        unlink(tmpfile.c_str());
+        return -1;
+    }
+    rename(file.c_str(), (file + ".bak").c_str());
+    return rename(tmpfile.c_str(), file.c_str());
+}
+
+/**
+ * @brief rebuild the sidecars of a camera from its access units,
+ *        pairs[k] is the record of access unit k, -1 if it has none
+ */
+static int repairCamera(const std::string& dir, uint32_t mcamId, int fd, AccessUnits& units,
+    const std::vector<FRAME_METADATA>& records, const std::vector<int64_t>& pairs, ValidateResult& result) {
+    size_t count = units.count();
+    // a last frame the stream does not hold completely cannot be decoded, cut it
+    if (result.truncated && count > 0 && pairs[count - 1] >= 0 &&
+        records[pairs[count - 1]].m_size > units.size(count - 1)) {
+        count--;
+        result.cutBytes = units.streamSize - units.starts[count];
+        if (ftruncate(fd, units.starts[count]) != 0)
+            return -1;
+    }
+    // frames without a record continue the frame period of the sidecar
+    std::vector<uint64_t> periods;
+    for (size_t i = 1; i < records.size(); i ++)
+        if (records[i].m_timestamp > records[i - 1].m_timestamp)
+            periods.push_back(records[i].m_timestamp - records[i - 1].m_timestamp);
+    uint64_t period = 0;
+    if (!periods.empty()) {
+        std::nth_element(periods.begin(), periods.begin() + periods.size() / 2, periods.end());
+        period = periods[periods.size() / 2];
+    }
+
+    std::string crcfile = checksumFileName(dir, mcamId);
+    FrameChecksum checksum;
+    std::vector<uint8_t> crcRecords;
+    readRecords(crcfile, &checksum, sizeof(checksum), crcRecords);
+    const FrameChecksum* checksums = crcRecords.empty() ? NULL : (const FrameChecksum*)&crcRecords[0];
+    size_t numChecksums = crcRecords.size() / sizeof(FrameChecksum);
+    bool writeChecksums = access(crcfile.c_str(), F_OK) == 0;
+
+    std::vector<FRAME_METADATA> repaired(count);
+    std::vector<FrameChecksum> repairedChecksums(count);
+    std::vector<uint8_t> data;
+    FRAME_METADATA last;
+    memset(&last, 0, sizeof(last));
+    last.m_camId = mcamId;
+    for (size_t k = 0; k < count; k ++) {
+        FRAME_METADATA& frameInfo = repaired[k];
+        bool changed = true;
+        if (pairs[k] >= 0) {
+            frameInfo = records[pairs[k]];
+            changed = frameInfo.m_size != units.size(k);
+        }
+        else {
+            frameInfo = last;
+            frameInfo.m_id = last.m_id + 1;
+            frameInfo.m_timestamp = last.m_timestamp + period;
+        }
+        frameInfo.m_size = units.size(k);
+        last = frameInfo;
+        if (changed)
+            result.repairedRecords++;
+        if (!writeChecksums)
+            continue;
+        if (!changed && (uint64_t)pairs[k] < numChecksums) {
+            repairedChecksums[k] = checksums[pairs[k]];
+            continue;
+        }
+        data.resize(frameInfo.m_size);
+        if (!data.empty() && pread(fd, &data[0], data.size(), units.starts[k]) != (ssize_t)data.size())
+            return -1;
+        repairedChecksums[k].data = crc32c(0, data.empty() ? NULL : &data[0], data.size());
+        repairedChecksums[k].meta = crc32c(0, &frameInfo, sizeof(frameInfo));
+    }
+
+    if (replaceFile(metaFileName(dir, mcamId), count ? &repaired[0] : NULL, count * sizeof(FRAME_METADATA)) != 0)
+        return -1;
+    if (writeChecksums &&
+        replaceFile(crcfile, count ? &repairedChecksums[0] : NULL, count * sizeof(FrameChecksum)) != 0)
+        return -1;
+    // the frame index no longer matches, it is built again on first use
+    unlink(indexFileName(dir, mcamId).c_str());
+    result.repaired = true;
+    return 0;
+}
+
+static void validateCamera(const std::string& dir, uint32_t mcamId, bool repair, ValidateResult& result) {
+    result.mcamId = mcamId;
+    result.codec = CODEC_UNKNOWN;
+    result.records = 0;
+    result.units = 0;
+    result.zeroSize = 0;
+    result.mismatched = 0;
+    result.extraRecords = 0;
+    result.missingRecords = 0;
+    result.timestampErrors = 0;
+    result.truncated = false;
+    result.repaired = false;
+    result.repairedRecords = 0;
+    result.cutBytes = 0;
+    std::string h264file = streamFileName(dir, mcamId);
+    int fd = open(h264file.c_str(), repair ? O_RDWR : O_RDONLY);
+    if (fd < 0) {
+        result.error = "cannot open stream file";
+        return;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    FRAME_METADATA frameInfo;
+    std::vector<uint8_t> metaRecords;
+    readRecords(metaFileName(dir, mcamId), &frameInfo, sizeof(frameInfo), metaRecords);
+    std::vector<FRAME_METADATA> records(metaRecords.size() / sizeof(FRAME_METADATA));
+    if (!records.empty())
+        memcpy(&records[0], &metaRecords[0], metaRecords.size());
+    AccessUnits units;
+    if (scanAccessUnits(fd, units) != 0) {
+        result.error = "cannot read stream file";
+        close(fd);
+        return;
+    }
+    result.codec = units.codec;
+    result.records = records.size();
+    result.units = units.count();
+
+    // pair the records of frames with the access units in order
+    std::vector<int64_t> pairs(units.count(), -1);
+    size_t k = 0;
+    uint64_t offset = 0;
+    uint64_t lastTimestamp = 0;
+    for (size_t j = 0; j < records.size(); j ++) {
+        const FRAME_METADATA& record = records[j];
+        bool bad = false;
+        if (record.m_size == 0) {
+            result.zeroSize++;
+            bad = true;
+        }
+        else {
+            if (offset + record.m_size > units.streamSize && offset < units.streamSize)
+                result.truncated = true;
+            else if (k >= units.count()) {
+                result.extraRecords++;
+                bad = true;
+            }
+            else if (record.m_size != units.size(k)) {
+                result.mismatched++;
+                bad = true;
+            }
+            if (k < units.count())
+                pairs[k++] = j;
+            offset += record.m_size;
+            if (j > 0 && record.m_timestamp <= lastTimestamp) {
+                result.timestampErrors++;
+                bad = true;
+            }
+            lastTimestamp = record.m_timestamp;
+        }
+        if (bad && result.badFrames.size() < kMaxReportedFrames)
+            result.badFrames.push_back(j);
+    }
+    result.missingRecords = units.count() - k;
+
+    if (repair && !result.ok() && repairCamera(dir, mcamId, fd, units, records, pairs, result) != 0)
+        result.error = "repair failed";
+    close(fd);
+}
+
+void printHelp() {
+    printf("Check the metadata sidecars of a recorded session against the streams\n");
+    printf("Usage: ValidateSession <session dir> [-r] [-j threads] [mcam id ...]\n");
+    printf("\t-r      rebuild the sidecars of inconsistent cameras from their streams\n");
+    printf("\t-j n    cameras validated in parallel (default: number of cores)\n");
+    printf("\tmcam id cameras to validate, default all cameras of the session\n");
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2 || strcmp(argv[1], "-h") == 0) {
+        printHelp();
+        return argc < 2 ? -1 : 0;
+    }
+    std::string dir = argv[1];
+    bool repair = false;
+    int threads = 0;
+    std::vector<uint32_t> ids;
+    for (int i = 2; i < argc; i ++) {
+        if (strcmp(argv[i], "-r") == 0)
+            repair = true;
+        else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else ids.push_back(atoi(argv[i]));
+    }
+    if (ids.empty())
+        ids = listCameras(dir);
+    if (ids.empty()) {
+        printf("No recorded camera in %s!\n", dir.c_str());
+        return -1;
+    }
+    printf("Validate %lu cameras in %s\n", ids.size(), dir.c_str());
+
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    std::vector<ValidateResult> results(ids.size());
+    parallelFor(ids.size(), threads, [&](size_t i) {
+        validateCamera(dir, ids[i], repair, results[i]);
+    });
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    int failed = 0;
+    int errors = 0;
+    for (size_t i = 0; i < results.size(); i ++) {
+        const ValidateResult& r = results[i];
+        if (!r.error.empty()) {
+            printf("Camera %u: FAILED, %s\n", r.mcamId, r.error.c_str());
+            errors++;
+            continue;
+        }
+        printf("Camera %u (%s): %s, %llu records, %llu frames in the stream", r.mcamId, codecName(r.codec),
+            r.ok() ? "OK" : "FAILED", (unsigned long long)r.records, (unsigned long long)r.units);
+        if (!r.ok()) {
+            printf(", %llu size mismatches, %llu zero size, %llu past the stream, %llu without record, "
+                "%llu timestamps out of order%s", (unsigned long long)r.mismatched,
+                (unsigned long long)r.zeroSize, (unsigned long long)r.extraRecords,
+                (unsigned long long)r.missingRecords, (unsigned long long)r.timestampErrors,
+                r.truncated ? ", stream truncated" : "");
+            failed++;
+        }
+        printf("\n");
+        if (!r.badFrames.empty()) {
+            printf("\tfirst bad records:");
+            for (size_t k = 0; k < r.badFrames.size(); k ++)
+                printf(" %llu", (unsigned long long)r.badFrames[k]);
+            printf("\n");
+        }
+        if (r.repaired)
+            printf("\trepaired: %llu records rebuilt, %llu bytes of a partial last frame cut\n",
+                (unsigned long long)r.repairedRecords, (unsigned long long)r.cutBytes);
+    }
+    printf("Validated %lu cameras in %.2f s, %d inconsistent, %d failed\n", results.size(), seconds, failed,
+        errors);
+    if (errors)
+        return -1;
+    return failed == 0 || repair ? 0 : 1;
+}
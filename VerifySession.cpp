@@ -0,0 +1,147 @@
+/******************************************************************************
+ *
+ * VerifySession.cpp
+ *
+ * Check the crc32c of every recorded frame and metadata record of a session
+ * against the mcam_crc_<id> sidecars written by RecordStream. Cameras are
+ * verified in parallel.
+ *
+ *****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <chrono>
+#include "mantis/MantisAPI.h"
+#include "SessionFiles.h"
+#include "ThreadPool.h"
+#include "CRC32C.h"
+
+struct VerifyResult {
+    uint32_t mcamId;
+    std::string error;              // set when the camera could not be verified
+    uint64_t frames;
+    uint64_t bytes;
+    uint64_t badData;               // frames whose bytes do not match the checksum
+    uint64_t badMeta;               // metadata records that do not match the checksum
+    uint64_t missingChecksums;      // frames without a checksum record
+    bool truncated;                 // stream file ends inside a frame
+    std::vector<uint64_t> badFrames;
+};
+
+static const size_t kMaxReportedFrames = 10;
+
+static void verifyCamera(const std::string& dir, uint32_t mcamId, VerifyResult& result) {
+    result.mcamId = mcamId;
+    result.frames = 0;
+    result.bytes = 0;
+    result.badData = 0;
+    result.badMeta = 0;
+    result.missingChecksums = 0;
+    result.truncated = false;
+
+    FILE* fpmeta = fopen(metaFileName(dir, mcamId).c_str(), "rb");
+    FILE* fph264 = fopen(streamFileName(dir, mcamId).c_str(), "rb");
+    FILE* fpcrc = fopen(checksumFileName(dir, mcamId).c_str(), "rb");
+    if (fpmeta == NULL || fph264 == NULL || fpcrc == NULL) {
+        result.error = fpcrc == NULL ? "no checksum file" : "cannot open stream files";
+        if (fpmeta) fclose(fpmeta);
+        if (fph264) fclose(fph264);
+        if (fpcrc) fclose(fpcrc);
+        return;
+    }
+    setvbuf(fph264, NULL, _IOFBF, 4 << 20);
+
+    std::vector<uint8_t> data(1 << 20);
+    FRAME_METADATA frameInfo;
+    FrameChecksum checksum;
+    for (;;) {
+        if (fread(&frameInfo, 1, sizeof(frameInfo), fpmeta) != sizeof(frameInfo))
+            break;
+        if (frameInfo.m_size > data.size())
+            data.resize(frameInfo.m_size);
+        if (fread(&data[0], 1, frameInfo.m_size, fph264) != frameInfo.m_size) {
+            result.truncated = true;
+            break;
+        }
+        bool bad = false;
+        if (fread(&checksum, 1, sizeof(checksum), fpcrc) != sizeof(checksum)) {
+            result.missingChecksums++;
+        }
+        else {
+            if (crc32c(0, &data[0], frameInfo.m_size) != checksum.data) {
+                result.badData++;
+                bad = true;
+            }
+            if (crc32c(0, &frameInfo, sizeof(frameInfo)) != checksum.meta) {
+                result.badMeta++;
+                bad = true;
+            }
+        }
+        if (bad && result.badFrames.size() < kMaxReportedFrames)
+            result.badFrames.push_back(result.frames);
+        result.frames++;
+        result.bytes += frameInfo.m_size;
+    }
+    fclose(fpmeta);
+    fclose(fph264);
+    fclose(fpcrc);
+}
+
+void printHelp() {
+    printf("Verify crc32c checksums of a recorded session\n");
+    printf("Usage: VerifySession <session dir> [threads]\n");
+    printf("\t<threads> cameras verified in parallel (default: number of cores)\n");
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2 || strcmp(argv[1], "-h") == 0) {
+        printHelp();
+        return argc < 2 ? -1 : 0;
+    }
+    std::string dir = argv[1];
+    int threads = argc > 2 ? atoi(argv[2]) : 0;
+
+    std::vector<uint32_t> ids = listCameras(dir);
+    if (ids.empty()) {
+        printf("No recorded camera in %s!\n", dir.c_str());
+        return -1;
+    }
+    printf("Verify %lu cameras in %s using %s crc32c\n", ids.size(), dir.c_str(), crc32cImplementation());
+
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    std::vector<VerifyResult> results(ids.size());
+    parallelFor(ids.size(), threads, [&](size_t i) {
+        verifyCamera(dir, ids[i], results[i]);
+    });
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    int failed = 0;
+    uint64_t totalBytes = 0;
+    for (size_t i = 0; i < results.size(); i ++) {
+        const VerifyResult& r = results[i];
+        totalBytes += r.bytes;
+        if (!r.error.empty()) {
+            printf("Camera %u: FAILED, %s\n", r.mcamId, r.error.c_str());
+            failed++;
+            continue;
+        }
+        bool ok = r.badData == 0 && r.badMeta == 0 && r.missingChecksums == 0 && !r.truncated;
+        printf("Camera %u: %s, %llu frames, %llu bad frames, %llu bad metadata, %llu without checksum%s\n",
+            r.mcamId, ok ? "OK" : "FAILED", (unsigned long long)r.frames, (unsigned long long)r.badData,
+            (unsigned long long)r.badMeta, (unsigned long long)r.missingChecksums,
+            r.truncated ? ", stream truncated" : "");
+        if (!r.badFrames.empty()) {
+            printf("\tfirst bad frames:");
+            for (size_t k = 0; k < r.badFrames.size(); k ++)
+                printf(" %llu", (unsigned long long)r.badFrames[k]);
+            printf("\n");
+        }
+        if (!ok)
+            failed++;
+    }
+    printf("Verified %.1f MB in %.2f s (%.1f MB/s), %d of %lu cameras failed\n", totalBytes / 1e6,
+        seconds, totalBytes / 1e6 / seconds, failed, results.size());
+    return failed == 0 ? 0 : 1;
+}
@@ -4,4 +4,4 @@
 # $3 output dir to save mp4 file and sync files
 ./cut_h264_stream.sh $1 $2
 ./decode.sh $2 $3
-./build/FindSyncFrames $2 $3/sync.txt
\ No newline at end of file
+./build/FindSyncFrames $2 $3/sync.idx -x $3/sync.txt
\ No newline at end of file